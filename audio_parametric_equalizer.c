@@ -1,4 +1,5 @@
 #include "audio_parametric_equalizer.h"
+#include "audio_parametric_equalizer_kernels.h"
 #include "array.h"
 #include "queue.h"
 #include <features.h>
@@ -7,29 +8,71 @@
 #include <malloc.h>
 #include <string.h>
 #include <math.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 
-/* Some useful constants. defined in math.h that might not be available to specific systems */
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
-#define SAMPLE_HISTORY_COUNT 2
 typedef struct _parametric_equalizer_data
 {
     APE_EqualizerHandle m_Handle;
     APE_FrequencySpectrum m_Spectrum;
-    float m_RawSamples[SAMPLE_HISTORY_COUNT];
-    float m_ProcessedSamples[SAMPLE_HISTORY_COUNT];
-    float m_A0;
-    float m_A1;
-    float m_A2;
-    float m_B0;
-    float m_B1;
-    float m_B2;
+    APE_FilterState m_Filter;
+    APE_Engine m_Engine;
+    APE_FixedState m_Fixed;
 } APE_CacheData;
 
-static Array _data_array = NULL;
-static Queue _data_graveyard = NULL;
+// snapshot layout: header, one APE_CacheData per handle (record index == handle), then the returned handles in graveyard order
+#define APE_SNAPSHOT_MAGIC 0x53455041 // "APES"
+#define APE_SNAPSHOT_VERSION 2
+typedef struct _snapshot_header
+{
+    uint32_t m_Magic;
+    uint32_t m_Version;
+    uint32_t m_RecordSize;
+    uint32_t m_RecordCount;
+    uint32_t m_ReturnedCount;
+    uint32_t m_Reserved[3];
+} APE_SnapshotHeader;
+
+#define CONTEXT_HEADER_UINT32 0x58544E43 // "CNTX"
+
+// cache data is handed out of chunks this big, placed on the context's node
+#define CONTEXT_CHUNK_SIZE (64 * 1024)
+
+// from linux/mempolicy.h.  preferred rather than bind so we still get memory when the node is full
+#define CONTEXT_MPOL_PREFERRED 1
+
+typedef struct _context_chunk
+{
+    struct _context_chunk* m_Next;
+    uint32_t m_Capacity;
+    uint32_t m_Used;
+    APE_CacheData m_Records[];
+} APE_ContextChunk;
+
+typedef struct _context_descriptor
+{
+    uint32_t m_Check;
+    int32_t m_NumaNode;
+    bool m_ShutdownWhenEmpty; // the default context tears itself down when the last handle is returned
+    Array m_DataArray;
+    Queue m_Graveyard;
+    APE_ContextChunk* m_Chunks;
+
+    // set when our cache data lives in a restored snapshot instead of the chunks
+    void* m_SnapshotMapping;
+    size_t m_SnapshotMappingSize;
+} APE_ContextData;
+
+static APE_ContextData _default_context = 
+{
+    .m_Check = CONTEXT_HEADER_UINT32,
+    .m_NumaNode = APE_CONTEXT_ANY_NODE,
+    .m_ShutdownWhenEmpty = true,
+};
 
 bool frequency_spectrum_changed(const APE_FrequencySpectrum* left, const APE_FrequencySpectrum* right)
 {
@@ -42,139 +85,538 @@ bool frequency_spectrum_changed(const APE_FrequencySpectrum* left, const APE_Fre
 }
 
 
-void ape_run_filter(APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const APE_Sample* const in_samples, APE_Sample* out_samples, uint32_t num_samples)
+static void update_coefficients(APE_CacheData* data, const APE_FrequencySpectrum* frequncy_sample)
+{
+    APE_SectionCoefficients coefficients;
+    ape_kernels_coefficients(frequncy_sample, &coefficients);
+
+    data->m_Spectrum = *frequncy_sample;
+    data->m_Filter.m_B0 = coefficients.m_B0;
+    data->m_Filter.m_B1 = coefficients.m_B1;
+    data->m_Filter.m_B2 = coefficients.m_B2;
+    data->m_Filter.m_A0 = 1;
+    data->m_Filter.m_A1 = coefficients.m_A1;
+    data->m_Filter.m_A2 = coefficients.m_A2;
+
+    if(data->m_Engine != APE_ENGINE_FLOAT)
+    {
+        ape_fixed_quantize(&data->m_Fixed, &coefficients, data->m_Engine);
+    }
+}
+
+// NOTE: the float coefficients are always kept.  the fixed point ones are quantized from the double coefficients, not the floats
+static void update_spectrum(APE_CacheData* data, const APE_FrequencySpectrum* frequncy_sample)
+{
+    if(frequency_spectrum_changed(&data->m_Spectrum, frequncy_sample))
+    {
+        update_coefficients(data, frequncy_sample);
+    }
+}
+
+// size of the stack buffers used to convert or interleave samples for the fixed point engines
+#define STACK_CHUNK_SAMPLES 64
+
+static APE_ContextData* get_context(APE_Context context)
 {
-    APE_CacheData* data = array_get(_data_array, handle);
+    APE_ContextData* context_info = context == NULL ? &_default_context : (APE_ContextData*)context;
+    assert(context_info->m_Check == CONTEXT_HEADER_UINT32 && "Invalid context.");
+    return context_info;
+}
+
+static APE_CacheData* get_data(APE_ContextData* context_info, APE_EqualizerHandle handle)
+{
+    APE_CacheData* data = array_get(context_info->m_DataArray, handle);
     assert(data != NULL && "Invalid handle points to incorrect data.");
+    return data;
+}
+
+// page aligned memory that prefers the given node.  the placement is a hint, so a failed mbind is ignored
+static void* allocate_on_node(size_t size, int32_t numa_node)
+{
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED)
+        return NULL;
+
+    if(numa_node >= 0 && numa_node < (int32_t)(sizeof(unsigned long) * 8))
+    {
+        unsigned long node_mask = 1ul << numa_node;
+        syscall(SYS_mbind, memory, size, CONTEXT_MPOL_PREFERRED, &node_mask, sizeof(unsigned long) * 8, 0);
+    }
+    return memory;
+}
+
+static APE_CacheData* allocate_data(APE_ContextData* context_info)
+{
+    APE_ContextChunk* chunk = context_info->m_Chunks;
+    if(chunk == NULL || chunk->m_Used == chunk->m_Capacity)
+    {
+        chunk = allocate_on_node(CONTEXT_CHUNK_SIZE, context_info->m_NumaNode);
+        if(chunk == NULL)
+            return NULL;
+
+        chunk->m_Next = context_info->m_Chunks;
+        chunk->m_Capacity = (CONTEXT_CHUNK_SIZE - sizeof(APE_ContextChunk)) / sizeof(APE_CacheData);
+        context_info->m_Chunks = chunk;
+    }
+
+    // fresh mappings are already zeroed
+    return &chunk->m_Records[chunk->m_Used++];
+}
+
+static void shutdown_data(APE_ContextData* context_info)
+{
+    queue_destroy(context_info->m_Graveyard);
+    array_destroy(context_info->m_DataArray);
+    context_info->m_Graveyard = NULL;
+    context_info->m_DataArray = NULL;
+
+    while(context_info->m_Chunks != NULL)
+    {
+        APE_ContextChunk* chunk = context_info->m_Chunks;
+        context_info->m_Chunks = chunk->m_Next;
+        munmap(chunk, CONTEXT_CHUNK_SIZE);
+    }
+
+    if(context_info->m_SnapshotMapping != NULL)
+    {
+        munmap(context_info->m_SnapshotMapping, context_info->m_SnapshotMappingSize);
+        context_info->m_SnapshotMapping = NULL;
+        context_info->m_SnapshotMappingSize = 0;
+    }
+}
+
+APE_Context ape_context_create(int32_t numa_node)
+{
+    if(numa_node == APE_CONTEXT_LOCAL_NODE)
+    {
+        uint32_t cpu = 0;
+        uint32_t node = 0;
+        numa_node = syscall(SYS_getcpu, &cpu, &node, NULL) == 0 ? (int32_t)node : APE_CONTEXT_ANY_NODE;
+    }
+
+    APE_ContextData* context_info = allocate_on_node(sizeof(APE_ContextData), numa_node);
+    if(context_info == NULL)
+        return NULL;
+
+    context_info->m_Check = CONTEXT_HEADER_UINT32;
+    context_info->m_NumaNode = numa_node;
+    context_info->m_ShutdownWhenEmpty = false;
+    return (APE_Context)context_info;
+}
+
+void ape_context_destroy(APE_Context context)
+{
+    APE_ContextData* context_info = get_context(context);
+    shutdown_data(context_info);
+
+    // the default context is static and can be used again
+    if(context_info != &_default_context)
+    {
+        context_info->m_Check = 0;
+        munmap(context_info, sizeof(APE_ContextData));
+    }
+}
+
+void ape_context_run_filter(APE_Context context, APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const APE_Sample* const in_samples, APE_Sample* out_samples, uint32_t num_samples)
+{
+    APE_CacheData* data = get_data(get_context(context), handle);
 
     // recalculate our filter coefficients if our spectrum parameters have changed
-    if(frequency_spectrum_changed(&data->m_Spectrum, frequncy_sample))
+    update_spectrum(data, frequncy_sample);
+
+    if(data->m_Engine == APE_ENGINE_FLOAT)
     {
-        // Maths based on https://8void.files.wordpress.com/2017/11/orfanidis.pdf
-        float gb_calc_0 = pow(10.0, frequncy_sample->m_BandwidthGain / 20.0);
-        float g0_calc_0 = pow(10.0, frequncy_sample->m_ReferenceGain / 20.0);
-        float g_calc_0  = pow(10.0, frequncy_sample->m_GainAdjustment / 20.0);
-        float gb_calc_1 = pow(gb_calc_0, 2.0);
-        float g0_calc_1 = pow(g0_calc_0, 2.0);
-        float g_calc_1  = pow(g_calc_0, 2.0);
-        float fs_half   = frequncy_sample->m_SampleRate / 2.0;
-
-        float beta = tan(frequncy_sample->m_Bandwidth / 2.0 * M_PI / (fs_half)) * 
-                    sqrt(fabs(gb_calc_1 - g0_calc_1)) / sqrt(fabs(0.001 + g_calc_1 - gb_calc_1));
-
-        float beta_p = 1.0 + beta;
-        float beta_m = 1.0 - beta;
-        float f0_cos_x2 = -2.0 * cos(frequncy_sample->m_Frequency * M_PI / fs_half) / beta_p;
-
-        data->m_Spectrum = *frequncy_sample;
-        data->m_B0 = (g0_calc_0 + g_calc_0 * beta) / beta_p;
-        data->m_B1 =  g0_calc_0 * f0_cos_x2;
-        data->m_B2 = (g0_calc_0 - g_calc_0 * beta) / beta_p;
-        data->m_A0 = 1;
-        data->m_A1 = f0_cos_x2;
-        data->m_A2 = beta_m / beta_p;
-    }
-
-    // apply the filter with our coefficients
-    const APE_Sample* in_0;
-    const APE_Sample* in_1;
-    const APE_Sample* in_2;
-    APE_Sample* out_0;
-    APE_Sample* out_1;
-    APE_Sample* out_2;
-
-    // run the first 2 with our cached data
-    in_0 = &in_samples[0];
-    in_1 = &data->m_RawSamples[0];
-    in_2 = &data->m_RawSamples[1];
-    out_0 = &out_samples[0];
-    out_1 = &data->m_ProcessedSamples[0];
-    out_2 = &data->m_ProcessedSamples[1];
-    *out_0 = ((data->m_B0 * *in_0) + 
-                (data->m_B1 * *in_1) + 
-                (data->m_B2 * *in_2) - 
-                (data->m_A1 * *out_1) - 
-                (data->m_A2 * *out_2)) * data->m_A0;
-
-    in_0 = &in_samples[1];
-    in_1 = &in_samples[0];;
-    in_2 = &data->m_RawSamples[0];
-    out_0 = &out_samples[1];
-    out_1 = &out_samples[0];
-    out_2 = &data->m_ProcessedSamples[0];
-    *out_0 = ((data->m_B0 * *in_0) + 
-                (data->m_B1 * *in_1) + 
-                (data->m_B2 * *in_2) - 
-                (data->m_A1 * *out_1) - 
-                (data->m_A2 * *out_2)) * data->m_A0;
-
-    // run the rest in loop
-    for(uint32_t sample_index = 2; sample_index < num_samples; ++sample_index)
-    {
-        in_0 = &in_samples[sample_index];
-        in_1 = &in_samples[sample_index - 1];
-        in_2 = &in_samples[sample_index - 2];
-        out_0 = &out_samples[sample_index];
-        out_1 = &out_samples[sample_index - 1];
-        out_2 = &out_samples[sample_index - 2];
-
-        *out_0 = ((data->m_B0 * *in_0) + 
-                  (data->m_B1 * *in_1) + 
-                  (data->m_B2 * *in_2) - 
-                  (data->m_A1 * *out_1) - 
-                  (data->m_A2 * *out_2)) * data->m_A0;
-    }
-
-    // cache the end values
-    data->m_ProcessedSamples[0] = out_samples[num_samples - 1];
-    data->m_ProcessedSamples[1] = out_samples[num_samples - 2];
-    data->m_RawSamples[0]   = in_samples[num_samples - 1];
-    data->m_RawSamples[1]   = in_samples[num_samples - 2];
+        // a single section always runs scalar.  ape_run_filter_lanes is the vectorized path
+        ape_kernels_filter_scalar(&data->m_Filter, in_samples, out_samples, num_samples);
+        return;
+    }
+
+    // fixed point handles convert through the stack a chunk at a time.  in_samples and out_samples may still be the same buffer
+    const double scale = data->m_Engine == APE_ENGINE_Q31 ? 2147483648.0 : 32768.0;
+    const double limit = data->m_Engine == APE_ENGINE_Q31 ? INT32_MAX : INT16_MAX;
+    for(uint32_t chunk_start = 0; chunk_start < num_samples; chunk_start += STACK_CHUNK_SAMPLES)
+    {
+        uint32_t chunk_size = num_samples - chunk_start < STACK_CHUNK_SAMPLES ? num_samples - chunk_start : STACK_CHUNK_SAMPLES;
+        if(data->m_Engine == APE_ENGINE_Q31)
+        {
+            int32_t chunk[STACK_CHUNK_SAMPLES];
+            for(uint32_t sample_index = 0; sample_index < chunk_size; ++sample_index)
+                chunk[sample_index] = (int32_t)fmax(-limit - 1, fmin(limit, round(in_samples[chunk_start + sample_index] * scale)));
+            ape_fixed_filter_q31(&data->m_Fixed, chunk, chunk, chunk_size);
+            for(uint32_t sample_index = 0; sample_index < chunk_size; ++sample_index)
+                out_samples[chunk_start + sample_index] = (APE_Sample)(chunk[sample_index] / scale);
+        }
+        else
+        {
+            int16_t chunk[STACK_CHUNK_SAMPLES];
+            for(uint32_t sample_index = 0; sample_index < chunk_size; ++sample_index)
+                chunk[sample_index] = (int16_t)fmax(-limit - 1, fmin(limit, round(in_samples[chunk_start + sample_index] * scale)));
+            ape_fixed_filter_q15(&data->m_Fixed, chunk, chunk, chunk_size);
+            for(uint32_t sample_index = 0; sample_index < chunk_size; ++sample_index)
+                out_samples[chunk_start + sample_index] = (APE_Sample)(chunk[sample_index] / scale);
+        }
+    }
 }
 
-APE_EqualizerHandle ape_obtain()
+void ape_context_run_filter_lanes(APE_Context context, const APE_EqualizerHandle* handles, const APE_FrequencySpectrum* frequncy_samples, uint32_t handle_count, const APE_Sample* const* in_samples, APE_Sample* const* out_samples, uint32_t num_samples)
 {
-    if(_data_array == NULL)
+    APE_ContextData* context_info = get_context(context);
+    APE_FilterLaneKernel lane_kernel = ape_kernels_filter_lanes();
+    for(uint32_t group_start = 0; group_start < handle_count; group_start += APE_FILTER_LANES)
     {
-        _data_array = array_create(8, false);
+        uint32_t lane_count = handle_count - group_start < APE_FILTER_LANES ? handle_count - group_start : APE_FILTER_LANES;
+        APE_FilterState* filters[APE_FILTER_LANES];
+        for(uint32_t lane_index = 0; lane_index < lane_count; ++lane_index)
+        {
+            APE_CacheData* data = get_data(context_info, handles[group_start + lane_index]);
+            assert(data->m_Engine == APE_ENGINE_FLOAT && "Handle is not using the float engine.");
+            update_spectrum(data, &frequncy_samples[group_start + lane_index]);
+            filters[lane_index] = &data->m_Filter;
+        }
+
+        lane_kernel(filters, lane_count, &in_samples[group_start], &out_samples[group_start], num_samples);
+    }
+}
+
+void ape_context_set_engine(APE_Context context, APE_EqualizerHandle handle, APE_Engine engine)
+{
+    assert(engine < APE_ENGINE_COUNT && "Invalid engine.");
+    APE_CacheData* data = get_data(get_context(context), handle);
+    data->m_Engine = engine;
+    memset(&data->m_Filter.m_RawSamples, 0, sizeof(data->m_Filter.m_RawSamples));
+    memset(&data->m_Filter.m_ProcessedSamples, 0, sizeof(data->m_Filter.m_ProcessedSamples));
+    memset(&data->m_Fixed, 0, sizeof(data->m_Fixed));
+
+    // a handle that has never been given a spectrum keeps zeroed coefficients until it is
+    if(engine != APE_ENGINE_FLOAT && data->m_Spectrum.m_SampleRate != 0)
+    {
+        APE_SectionCoefficients coefficients;
+        ape_kernels_coefficients(&data->m_Spectrum, &coefficients);
+        ape_fixed_quantize(&data->m_Fixed, &coefficients, engine);
+    }
+}
+
+APE_Engine ape_context_get_engine(APE_Context context, APE_EqualizerHandle handle)
+{
+    return get_data(get_context(context), handle)->m_Engine;
+}
+
+void ape_context_run_filter_q31(APE_Context context, APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const int32_t* in_samples, int32_t* out_samples, uint32_t num_samples)
+{
+    APE_CacheData* data = get_data(get_context(context), handle);
+    assert(data->m_Engine == APE_ENGINE_Q31 && "Handle is not using the Q31 engine.");
+    update_spectrum(data, frequncy_sample);
+    ape_fixed_filter_q31(&data->m_Fixed, in_samples, out_samples, num_samples);
+}
+
+void ape_context_run_filter_q15(APE_Context context, APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const int16_t* in_samples, int16_t* out_samples, uint32_t num_samples)
+{
+    APE_CacheData* data = get_data(get_context(context), handle);
+    assert(data->m_Engine == APE_ENGINE_Q15 && "Handle is not using the Q15 engine.");
+    update_spectrum(data, frequncy_sample);
+    ape_fixed_filter_q15(&data->m_Fixed, in_samples, out_samples, num_samples);
+}
+
+void ape_context_run_filter_q15_lanes(APE_Context context, const APE_EqualizerHandle* handles, const APE_FrequencySpectrum* frequncy_samples, uint32_t handle_count, const int16_t* const* in_samples, int16_t* const* out_samples, uint32_t num_samples)
+{
+    APE_ContextData* context_info = get_context(context);
+    APE_Q15LaneKernel lane_kernel = ape_kernels_filter_q15_lanes();
+    for(uint32_t group_start = 0; group_start < handle_count; group_start += APE_Q15_LANES)
+    {
+        uint32_t lane_count = handle_count - group_start < APE_Q15_LANES ? handle_count - group_start : APE_Q15_LANES;
+        APE_FixedState* states[APE_Q15_LANES];
+        for(uint32_t lane_index = 0; lane_index < lane_count; ++lane_index)
+        {
+            APE_CacheData* data = get_data(context_info, handles[group_start + lane_index]);
+            assert(data->m_Engine == APE_ENGINE_Q15 && "Handle is not using the Q15 engine.");
+            update_spectrum(data, &frequncy_samples[group_start + lane_index]);
+            states[lane_index] = &data->m_Fixed;
+        }
+
+        // interleave a chunk of every lane, filter them together, then split them back out
+        int16_t in_chunk[STACK_CHUNK_SAMPLES * APE_Q15_LANES] = { 0 };
+        int16_t out_chunk[STACK_CHUNK_SAMPLES * APE_Q15_LANES];
+        for(uint32_t chunk_start = 0; chunk_start < num_samples; chunk_start += STACK_CHUNK_SAMPLES)
+        {
+            uint32_t chunk_size = num_samples - chunk_start < STACK_CHUNK_SAMPLES ? num_samples - chunk_start : STACK_CHUNK_SAMPLES;
+            for(uint32_t lane_index = 0; lane_index < lane_count; ++lane_index)
+            {
+                const int16_t* lane_in = &in_samples[group_start + lane_index][chunk_start];
+                for(uint32_t sample_index = 0; sample_index < chunk_size; ++sample_index)
+                    in_chunk[(sample_index * APE_Q15_LANES) + lane_index] = lane_in[sample_index];
+            }
+
+            lane_kernel(states, lane_count, in_chunk, out_chunk, chunk_size);
+
+            for(uint32_t lane_index = 0; lane_index < lane_count; ++lane_index)
+            {
+                int16_t* lane_out = &out_samples[group_start + lane_index][chunk_start];
+                for(uint32_t sample_index = 0; sample_index < chunk_size; ++sample_index)
+                    lane_out[sample_index] = out_chunk[(sample_index * APE_Q15_LANES) + lane_index];
+            }
+        }
+    }
+}
+
+void ape_context_set_spectrum(APE_Context context, APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample)
+{
+    update_spectrum(get_data(get_context(context), handle), frequncy_sample);
+}
+
+APE_FilterState* ape_context_get_filter_state(APE_Context context, APE_EqualizerHandle handle)
+{
+    return &get_data(get_context(context), handle)->m_Filter;
+}
+
+APE_EqualizerHandle ape_context_obtain(APE_Context context)
+{
+    APE_ContextData* context_info = get_context(context);
+    if(context_info->m_DataArray == NULL)
+    {
+        context_info->m_DataArray = array_create(8, false);
+        ape_kernels_init();
     }
 
     APE_CacheData* target_cache = NULL;
-    if(_data_graveyard != NULL && !queue_is_empty(_data_graveyard))
+    if(context_info->m_Graveyard != NULL && !queue_is_empty(context_info->m_Graveyard))
     {
-        target_cache = queue_pop_front(_data_graveyard);
+        target_cache = queue_pop_front(context_info->m_Graveyard);
         memset(((uint8_t*)target_cache) + sizeof(APE_EqualizerHandle), 0, sizeof(APE_CacheData) -  sizeof(APE_EqualizerHandle));
     }
     else
     {
-        target_cache = calloc(1, sizeof(APE_CacheData));
+        target_cache = allocate_data(context_info);
         assert(target_cache != NULL && "Unable to allocate new cache data");
 
-        target_cache->m_Handle = array_size(_data_array);
-        assert(array_push_back(_data_array, target_cache) && "Unable to push new data to our storage.");
+        target_cache->m_Handle = array_size(context_info->m_DataArray);
+        bool pushed = array_push_back(context_info->m_DataArray, target_cache);
+        assert(pushed && "Unable to push new data to our storage.");
+        (void)pushed;
     }
     return target_cache->m_Handle;    
 }
 
-void ape_return(APE_EqualizerHandle handle)
+void ape_context_return(APE_Context context, APE_EqualizerHandle handle)
 {
-    if(_data_graveyard == NULL)
+    APE_ContextData* context_info = get_context(context);
+    if(context_info->m_Graveyard == NULL)
     {
-        _data_graveyard = queue_create();
+        context_info->m_Graveyard = queue_create();
     }
 
-    APE_CacheData* data = array_get(_data_array, handle);
-    assert(data != NULL && "Invalid handle points to incorrect data.");
-    queue_push_back(_data_graveyard, data);
+    APE_CacheData* data = get_data(context_info, handle);
+    queue_push_back(context_info->m_Graveyard, data);
 
     // we should be ok to shutdown if we have returned everything we have allocated
-    if(queue_size(_data_graveyard) == array_size(_data_array))
+    if(context_info->m_ShutdownWhenEmpty && queue_size(context_info->m_Graveyard) == array_size(context_info->m_DataArray))
+    {
+        shutdown_data(context_info);
+    }
+}
+
+bool ape_context_snapshot_save(APE_Context context, const char* path)
+{
+    APE_ContextData* context_info = get_context(context);
+    APE_SnapshotHeader header;
+    memset(&header, 0, sizeof(APE_SnapshotHeader));
+    header.m_Magic = APE_SNAPSHOT_MAGIC;
+    header.m_Version = APE_SNAPSHOT_VERSION;
+    header.m_RecordSize = sizeof(APE_CacheData);
+    header.m_RecordCount = array_size(context_info->m_DataArray);
+    header.m_ReturnedCount = queue_size(context_info->m_Graveyard);
+
+    FILE* file = fopen(path, "wb");
+    if(file == NULL)
+        return false;
+
+    bool success = fwrite(&header, sizeof(APE_SnapshotHeader), 1, file) == 1;
+    for(uint32_t array_index = 0; success && array_index < header.m_RecordCount; ++array_index)
+    {
+        success = fwrite(array_get(context_info->m_DataArray, array_index), sizeof(APE_CacheData), 1, file) == 1;
+    }
+
+    // rotate through the graveyard so it is left in the same order we found it
+    for(uint32_t returned_index = 0; returned_index < header.m_ReturnedCount; ++returned_index)
+    {
+        APE_CacheData* data = queue_pop_front(context_info->m_Graveyard);
+        queue_push_back(context_info->m_Graveyard, data);
+        success = success && fwrite(&data->m_Handle, sizeof(APE_EqualizerHandle), 1, file) == 1;
+    }
+
+    return fclose(file) == 0 && success;
+}
+
+// a record from a snapshot has to be in the slot for its handle and use an engine (and fixed point state) the filters
+// can run without overflowing
+static bool is_valid_record(const APE_CacheData* data, uint32_t record_index)
+{
+    if(data->m_Handle != record_index || (uint32_t)data->m_Engine >= APE_ENGINE_COUNT)
+        return false;
+
+    return data->m_Engine == APE_ENGINE_FLOAT || ape_fixed_state_valid(&data->m_Fixed, data->m_Engine);
+}
+
+bool ape_context_snapshot_restore(APE_Context context, const char* path)
+{
+    // we only restore over an empty state.  a context that has had every handle returned keeps its pool around,
+    // so drop it here instead of making the caller destroy the context first
+    APE_ContextData* context_info = get_context(context);
+    if(queue_size(context_info->m_Graveyard) != array_size(context_info->m_DataArray))
+        return false;
+    shutdown_data(context_info);
+
+    int file = open(path, O_RDONLY);
+    if(file < 0)
+        return false;
+
+    struct stat file_info;
+    if(fstat(file, &file_info) != 0 || (size_t)file_info.st_size < sizeof(APE_SnapshotHeader))
+    {
+        close(file);
+        return false;
+    }
+
+    // private mapping so the cache data can be written to without touching the file
+    size_t mapping_size = file_info.st_size;
+    void* mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if(mapping == MAP_FAILED)
+        return false;
+
+    const APE_SnapshotHeader* header = mapping;
+    if( header->m_Magic != APE_SNAPSHOT_MAGIC || 
+        header->m_Version != APE_SNAPSHOT_VERSION || 
+        header->m_RecordSize != sizeof(APE_CacheData) ||
+        header->m_ReturnedCount > header->m_RecordCount ||
+        mapping_size != sizeof(APE_SnapshotHeader) + 
+                        (sizeof(APE_CacheData) * (size_t)header->m_RecordCount) + 
+                        (sizeof(APE_EqualizerHandle) * (size_t)header->m_ReturnedCount))
+    {
+        munmap(mapping, mapping_size);
+        return false;
+    }
+    APE_CacheData* records = (APE_CacheData*)(((uint8_t*)mapping) + sizeof(APE_SnapshotHeader));
+    const APE_EqualizerHandle* returned = (const APE_EqualizerHandle*)(records + header->m_RecordCount);
+
+    // nothing to restore
+    if(header->m_RecordCount == 0)
+    {
+        munmap(mapping, mapping_size);
+        return true;
+    }
+
+    // the pages we write to get copied, so have those copies land on our node
+    if(context_info->m_NumaNode >= 0 && context_info->m_NumaNode < (int32_t)(sizeof(unsigned long) * 8))
+    {
+        unsigned long node_mask = 1ul << context_info->m_NumaNode;
+        syscall(SYS_mbind, mapping, mapping_size, CONTEXT_MPOL_PREFERRED, &node_mask, sizeof(unsigned long) * 8, 0);
+    }
+
+    // point our storage straight at the mapped records.  no per-record allocation, copy, or coefficient recalculation.
+    // NOTE: the graveyard is a linked queue, so each returned handle still costs one queue node
+    if(context_info->m_DataArray == NULL)
+    {
+        context_info->m_DataArray = array_create(header->m_RecordCount + 1, false);
+        ape_kernels_init();
+    }
+    if(context_info->m_Graveyard == NULL)
     {
-        queue_destroy(_data_graveyard);
-        for(uint32_t array_index = 0; array_index < array_size(_data_array); ++array_index)
+        context_info->m_Graveyard = queue_create();
+    }
+    context_info->m_SnapshotMapping = mapping;
+    context_info->m_SnapshotMappingSize = mapping_size;
+
+    bool success = true;
+    for(uint32_t record_index = 0; success && record_index < header->m_RecordCount; ++record_index)
+    {
+        success = is_valid_record(&records[record_index], record_index) && array_push_back(context_info->m_DataArray, &records[record_index]);
+    }
+
+    // a handle listed twice would be handed out twice, so track which ones we have seen
+    uint8_t* returned_seen = calloc((header->m_RecordCount + 7) / 8, 1);
+    success = success && returned_seen != NULL;
+    for(uint32_t returned_index = 0; success && returned_index < header->m_ReturnedCount; ++returned_index)
+    {
+        APE_EqualizerHandle handle = returned[returned_index];
+        success = handle < header->m_RecordCount && (returned_seen[handle / 8] & (1u << (handle % 8))) == 0;
+        if(success)
         {
-            free(array_get(_data_array, array_index));
+            returned_seen[handle / 8] |= (uint8_t)(1u << (handle % 8));
+            success = queue_push_back(context_info->m_Graveyard, &records[handle]);
         }
-        array_destroy(_data_array);
     }
+    free(returned_seen);
+
+    if(!success)
+    {
+        shutdown_data(context_info);
+    }
+    return success;
+}
+
+// the original api works on the default context
+
+APE_EqualizerHandle ape_obtain()
+{
+    return ape_context_obtain(NULL);
+}
+
+void ape_return(APE_EqualizerHandle handle)
+{
+    ape_context_return(NULL, handle);
+}
+
+void ape_run_filter(APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const APE_Sample* const in_samples, APE_Sample* out_samples, uint32_t num_samples)
+{
+    ape_context_run_filter(NULL, handle, frequncy_sample, in_samples, out_samples, num_samples);
+}
+
+void ape_run_filter_lanes(const APE_EqualizerHandle* handles, const APE_FrequencySpectrum* frequncy_samples, uint32_t handle_count, const APE_Sample* const* in_samples, APE_Sample* const* out_samples, uint32_t num_samples)
+{
+    ape_context_run_filter_lanes(NULL, handles, frequncy_samples, handle_count, in_samples, out_samples, num_samples);
+}
+
+void ape_set_spectrum(APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample)
+{
+    ape_context_set_spectrum(NULL, handle, frequncy_sample);
+}
+
+APE_FilterState* ape_get_filter_state(APE_EqualizerHandle handle)
+{
+    return ape_context_get_filter_state(NULL, handle);
+}
+
+bool ape_snapshot_save(const char* path)
+{
+    return ape_context_snapshot_save(NULL, path);
+}
+
+bool ape_snapshot_restore(const char* path)
+{
+    return ape_context_snapshot_restore(NULL, path);
+}
+
+void ape_set_engine(APE_EqualizerHandle handle, APE_Engine engine)
+{
+    ape_context_set_engine(NULL, handle, engine);
+}
+
+APE_Engine ape_get_engine(APE_EqualizerHandle handle)
+{
+    return ape_context_get_engine(NULL, handle);
+}
+
+void ape_run_filter_q31(APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const int32_t* in_samples, int32_t* out_samples, uint32_t num_samples)
+{
+    ape_context_run_filter_q31(NULL, handle, frequncy_sample, in_samples, out_samples, num_samples);
+}
+
+void ape_run_filter_q15(APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const int16_t* in_samples, int16_t* out_samples, uint32_t num_samples)
+{
+    ape_context_run_filter_q15(NULL, handle, frequncy_sample, in_samples, out_samples, num_samples);
+}
+
+void ape_run_filter_q15_lanes(const APE_EqualizerHandle* handles, const APE_FrequencySpectrum* frequncy_samples, uint32_t handle_count, const int16_t* const* in_samples, int16_t* const* out_samples, uint32_t num_samples)
+{
+    ape_context_run_filter_q15_lanes(NULL, handles, frequncy_samples, handle_count, in_samples, out_samples, num_samples);
 }
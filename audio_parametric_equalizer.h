@@ -2,6 +2,7 @@
 #define AUDIO_PARAMETRIC_EQUALIZER
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct _frequency_spectrum_descriptor_
 {
@@ -16,9 +17,145 @@ typedef struct _frequency_spectrum_descriptor_
 typedef uint32_t APE_EqualizerHandle;
 typedef float APE_Sample;
 
+#define APE_SAMPLE_HISTORY_COUNT 2
+typedef struct _filter_state
+{
+    float m_RawSamples[APE_SAMPLE_HISTORY_COUNT];       // x[n-1], x[n-2]
+    float m_ProcessedSamples[APE_SAMPLE_HISTORY_COUNT]; // y[n-1], y[n-2]
+    float m_A0;                                         // always normalized to 1
+    float m_A1;
+    float m_A2;
+    float m_B0;
+    float m_B1;
+    float m_B2;
+} APE_FilterState;
+
 APE_EqualizerHandle ape_obtain();
 void ape_return(APE_EqualizerHandle handle);
 
 void ape_run_filter(APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const APE_Sample* const in_samples, APE_Sample* out_samples, uint32_t num_samples);
 
+// run many handles over their own buffers, packed side by side into vector lanes.  gives the same output as calling
+// ape_run_filter on each handle, and is much faster once there are a few handles to fill the lanes
+// NOTE: the handles have to be using APE_ENGINE_FLOAT and be different from each other.  a handle may filter in place,
+//       but the handles cant share buffers
+void ape_run_filter_lanes(const APE_EqualizerHandle* handles, const APE_FrequencySpectrum* frequncy_samples, uint32_t handle_count, const APE_Sample* const* in_samples, APE_Sample* const* out_samples, uint32_t num_samples);
+
+// the instruction sets ape_run_filter_lanes and ape_run_filter_q15_lanes can dispatch to.  the widest one the cpu supports,
+// up to avx2, is picked on the first ape_obtain.  avx512 is no faster so it is only used when asked for.
+// ape_run_filter always runs the scalar kernel: a single section's recursion cant go wide without changing its rounding,
+// and only vectorizing the feed-forward half was slower than plain scalar
+// NOTE: the APE_KERNEL environment variable (scalar, sse2, avx2, avx512) overrides the pick when the cpu supports it
+// NOTE: the kernels only match each other bit for bit if the compiler never fuses a multiply and add.
+//       audio_parametric_equalizer_kernels.c asks for that with pragmas, but build it with -ffp-contract=off to be sure
+typedef enum _kernel_type
+{
+    APE_KERNEL_SCALAR,
+    APE_KERNEL_SSE2,
+    APE_KERNEL_AVX2,
+    APE_KERNEL_AVX512,
+    APE_KERNEL_COUNT
+} APE_Kernel;
+
+// force a kernel.  returns false if the cpu cant run it
+bool ape_set_kernel(APE_Kernel kernel);
+
+// the kernel currently in use
+APE_Kernel ape_get_kernel();
+
+// printable name of a kernel, or NULL if invalid
+const char* ape_kernel_name(APE_Kernel kernel);
+
+// how a handle does its math.  the fixed point engines quantize coefficients worked out in double, and give the same
+// output for the same spectrum and input on any machine and any build (harness/fixed_point_regression.c checks it)
+//      APE_ENGINE_Q31 - Q31 samples, int64 accumulator with first order error feedback
+//      APE_ENGINE_Q15 - Q15 samples, saturating 16 bit math.  ape_run_filter_q15_lanes runs 16 handles per AVX2 register
+// NOTE: ape_run_filter still works on fixed point handles, converting the samples to and from the engine's format
+// NOTE: the coefficients come from libm's pow, tan, and cos, so the output also depends on the libm they were built with
+// NOTE: Q15 coefficients are too coarse for sections low in the band, where the poles sit close to 1.  against a double
+//       filter (bandwidth f0 / 2, white noise) it gives about 60 dB SNR at f0 = fs / 12, 40 dB at fs / 50, 20 dB at
+//       fs / 250, and less than nothing below fs / 1000, losing about 10 dB per octave lower.  200 Hz at 48 kHz is
+//       21 dB and 60 Hz at 192 kHz is -11 dB.  use Q31 for anything under about fs / 50, it stays above 80 dB down to
+//       20 Hz at 192 kHz
+typedef enum _engine_type
+{
+    APE_ENGINE_FLOAT,
+    APE_ENGINE_Q31,
+    APE_ENGINE_Q15,
+    APE_ENGINE_COUNT
+} APE_Engine;
+
+// switch engines.  the filter history is cleared
+void ape_set_engine(APE_EqualizerHandle handle, APE_Engine engine);
+APE_Engine ape_get_engine(APE_EqualizerHandle handle);
+
+// the handle has to be using the matching engine
+void ape_run_filter_q31(APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const int32_t* in_samples, int32_t* out_samples, uint32_t num_samples);
+void ape_run_filter_q15(APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const int16_t* in_samples, int16_t* out_samples, uint32_t num_samples);
+
+// run many Q15 handles over their own buffers, packed side by side into vector lanes
+void ape_run_filter_q15_lanes(const APE_EqualizerHandle* handles, const APE_FrequencySpectrum* frequncy_samples, uint32_t handle_count, const int16_t* const* in_samples, int16_t* const* out_samples, uint32_t num_samples);
+
+// recalculate the handle's coefficients if the spectrum has changed.  needed when only using ape_process_sample
+void ape_set_spectrum(APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample);
+
+// gives the filter state behind the handle for ape_process_sample.  valid until the handle is returned
+// NOTE: this is the float engine, fixed point handles keep their history elsewhere
+APE_FilterState* ape_get_filter_state(APE_EqualizerHandle handle);
+
+// filter a single sample.  no handle lookup or spectrum change detection; use ape_set_spectrum for that
+static inline APE_Sample ape_process_sample(APE_FilterState* filter, APE_Sample in_0)
+{
+    APE_Sample out_0 =  (filter->m_B0 * in_0) + 
+                        (filter->m_B1 * filter->m_RawSamples[0]) + 
+                        (filter->m_B2 * filter->m_RawSamples[1]) - 
+                        (filter->m_A1 * filter->m_ProcessedSamples[0]) - 
+                        (filter->m_A2 * filter->m_ProcessedSamples[1]);
+
+    filter->m_RawSamples[1] = filter->m_RawSamples[0];
+    filter->m_RawSamples[0] = in_0;
+    filter->m_ProcessedSamples[1] = filter->m_ProcessedSamples[0];
+    filter->m_ProcessedSamples[0] = out_0;
+    return out_0;
+}
+
+// write every handle (live and returned) with its spectrum, coefficients, and sample history to a binary snapshot
+// NOTE: the snapshot is in the native layout of the machine that wrote it
+bool ape_snapshot_save(const char* path);
+
+// map a snapshot back in as the equalizer state.  handles are restored as-is and the first block wont recalculate.
+// the records are used straight from the mapping, but each returned handle allocates a graveyard node (plus a bitmap
+// for the duplicate check while restoring)
+// NOTE: only works when no handles are currently obtained.  any handles that were returned are dropped, even if
+//       the restore fails
+bool ape_snapshot_restore(const char* path);
+
+// an isolated engine with its own handle pool.  handles only mean something to the context that gave them out.
+// the functions without a context use the default one, as does passing NULL as the context
+typedef void* APE_Context;
+
+#define APE_CONTEXT_LOCAL_NODE -1   // the numa node the creating thread is running on
+#define APE_CONTEXT_ANY_NODE   -2   // leave the placement to the kernel
+
+// gives you an empty context whose cache data prefers the given numa node
+// NOTE: unlike the default context, it keeps its memory when every handle is returned until it is destroyed
+APE_Context ape_context_create(int32_t numa_node);
+
+// destroy the context and everything it gave out.  destroying the default context resets it
+void ape_context_destroy(APE_Context context);
+
+APE_EqualizerHandle ape_context_obtain(APE_Context context);
+void ape_context_return(APE_Context context, APE_EqualizerHandle handle);
+void ape_context_run_filter(APE_Context context, APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const APE_Sample* const in_samples, APE_Sample* out_samples, uint32_t num_samples);
+void ape_context_run_filter_lanes(APE_Context context, const APE_EqualizerHandle* handles, const APE_FrequencySpectrum* frequncy_samples, uint32_t handle_count, const APE_Sample* const* in_samples, APE_Sample* const* out_samples, uint32_t num_samples);
+void ape_context_set_spectrum(APE_Context context, APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample);
+APE_FilterState* ape_context_get_filter_state(APE_Context context, APE_EqualizerHandle handle);
+bool ape_context_snapshot_save(APE_Context context, const char* path);
+bool ape_context_snapshot_restore(APE_Context context, const char* path);
+void ape_context_set_engine(APE_Context context, APE_EqualizerHandle handle, APE_Engine engine);
+APE_Engine ape_context_get_engine(APE_Context context, APE_EqualizerHandle handle);
+void ape_context_run_filter_q31(APE_Context context, APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const int32_t* in_samples, int32_t* out_samples, uint32_t num_samples);
+void ape_context_run_filter_q15(APE_Context context, APE_EqualizerHandle handle, const APE_FrequencySpectrum* frequncy_sample, const int16_t* in_samples, int16_t* out_samples, uint32_t num_samples);
+void ape_context_run_filter_q15_lanes(APE_Context context, const APE_EqualizerHandle* handles, const APE_FrequencySpectrum* frequncy_samples, uint32_t handle_count, const int16_t* const* in_samples, int16_t* const* out_samples, uint32_t num_samples);
+
 #endif
\ No newline at end of file
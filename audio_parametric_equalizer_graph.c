@@ -0,0 +1,724 @@
+#define _GNU_SOURCE
+#include "audio_parametric_equalizer_graph.h"
+#include "array.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#define GRAPH_HEADER_UINT32 0x48505247 // "GRPH"
+#define GRAPH_BUFFER_ALIGNMENT 64
+
+typedef struct _graph_edge
+{
+    APE_GraphNode m_Source;
+    float m_Gain;
+} APE_GraphEdge;
+
+typedef struct _graph_node
+{
+    APE_EqualizerHandle* m_Handles;
+    APE_FrequencySpectrum* m_Spectrums;
+    uint32_t m_HandleCount;
+    Array m_Inputs; // APE_GraphEdge*
+    const APE_Sample* m_BoundInput;
+    APE_Sample* m_BoundOutput;
+
+    // filled in by ape_graph_compile
+    APE_GraphNode* m_Consumers;
+    uint32_t m_ConsumerCount;
+    uint32_t m_Cost;
+    uint32_t m_Priority;
+    uint32_t m_Start;
+    uint32_t m_Worker;
+    uint32_t m_Buffer;
+    atomic_uint m_PendingInputs;
+} APE_GraphNodeData;
+
+typedef struct _graph_worker
+{
+    struct _graph_descriptor* m_Graph;
+    APE_GraphNode* m_Nodes;
+    uint32_t m_NodeCount;
+    pthread_t m_Thread;
+} APE_GraphWorker;
+
+typedef struct _graph_descriptor
+{
+    uint32_t m_Check;
+    uint32_t m_MaxBlockSize;
+    APE_Context m_Context;
+    Array m_Nodes; // APE_GraphNodeData*
+    bool m_Compiled;
+
+    // filled in by ape_graph_compile
+    APE_GraphWorker* m_Workers;
+    uint32_t m_WorkerCount;
+    APE_Sample* m_Buffers;
+    uint32_t m_BufferCount;
+    uint32_t m_ThreadCount;
+    pthread_mutex_t m_Lock;
+    pthread_cond_t m_StartCondition;
+    pthread_cond_t m_DoneCondition;
+    uint32_t m_RunGeneration;
+    uint32_t m_FinishedCount;
+    uint32_t m_RunSamples;
+    bool m_Shutdown;
+} APE_GraphData;
+
+static bool is_valid_graph(const APE_GraphData* graph_info)
+{
+    return graph_info && graph_info->m_Check == GRAPH_HEADER_UINT32;
+}
+
+static APE_GraphNodeData* get_node(const APE_GraphData* graph_info, APE_GraphNode node)
+{
+    return array_get(graph_info->m_Nodes, node);
+}
+
+static APE_Sample* node_output(APE_GraphData* graph_info, APE_GraphNodeData* node_info)
+{
+    if(node_info->m_BoundOutput != NULL)
+        return node_info->m_BoundOutput;
+    return &graph_info->m_Buffers[node_info->m_Buffer * graph_info->m_MaxBlockSize];
+}
+
+static void mix_input(APE_Sample* out_samples, const APE_Sample* in_samples, float gain, bool first, uint32_t num_samples)
+{
+    if(first && gain == 1.0f)
+    {
+        memcpy(out_samples, in_samples, sizeof(APE_Sample) * num_samples);
+    }
+    else if(first)
+    {
+        for(uint32_t sample_index = 0; sample_index < num_samples; ++sample_index)
+            out_samples[sample_index] = in_samples[sample_index] * gain;
+    }
+    else
+    {
+        for(uint32_t sample_index = 0; sample_index < num_samples; ++sample_index)
+            out_samples[sample_index] += in_samples[sample_index] * gain;
+    }
+}
+
+static void run_node(APE_GraphData* graph_info, APE_GraphNode node)
+{
+    APE_GraphNodeData* node_info = get_node(graph_info, node);
+    uint32_t num_samples = graph_info->m_RunSamples;
+
+    // wait on anything feeding us from another worker
+    while(atomic_load_explicit(&node_info->m_PendingInputs, memory_order_acquire) != 0)
+    {
+        sched_yield();
+    }
+
+    // mix everything into our output then filter it in place
+    APE_Sample* out_samples = node_output(graph_info, node_info);
+    bool first = true;
+    if(node_info->m_BoundInput != NULL)
+    {
+        mix_input(out_samples, node_info->m_BoundInput, 1.0f, first, num_samples);
+        first = false;
+    }
+    for(uint32_t input_index = 0; input_index < array_size(node_info->m_Inputs); ++input_index)
+    {
+        APE_GraphEdge* edge = array_get(node_info->m_Inputs, input_index);
+        mix_input(out_samples, node_output(graph_info, get_node(graph_info, edge->m_Source)), edge->m_Gain, first, num_samples);
+        first = false;
+    }
+    if(first)
+    {
+        memset(out_samples, 0, sizeof(APE_Sample) * num_samples);
+    }
+
+    for(uint32_t handle_index = 0; handle_index < node_info->m_HandleCount; ++handle_index)
+    {
+        ape_context_run_filter(graph_info->m_Context, node_info->m_Handles[handle_index], &node_info->m_Spectrums[handle_index], out_samples, out_samples, num_samples);
+    }
+
+    // let our consumers go
+    for(uint32_t consumer_index = 0; consumer_index < node_info->m_ConsumerCount; ++consumer_index)
+    {
+        APE_GraphNodeData* consumer = get_node(graph_info, node_info->m_Consumers[consumer_index]);
+        atomic_fetch_sub_explicit(&consumer->m_PendingInputs, 1, memory_order_release);
+    }
+}
+
+static void run_worker(APE_GraphWorker* worker)
+{
+    for(uint32_t node_index = 0; node_index < worker->m_NodeCount; ++node_index)
+    {
+        run_node(worker->m_Graph, worker->m_Nodes[node_index]);
+    }
+}
+
+static void* worker_thread(void* user_data)
+{
+    APE_GraphWorker* worker = user_data;
+    APE_GraphData* graph_info = worker->m_Graph;
+    uint32_t run_generation = 0;
+    while(true)
+    {
+        pthread_mutex_lock(&graph_info->m_Lock);
+        while(graph_info->m_RunGeneration == run_generation && !graph_info->m_Shutdown)
+        {
+            pthread_cond_wait(&graph_info->m_StartCondition, &graph_info->m_Lock);
+        }
+        run_generation = graph_info->m_RunGeneration;
+        bool shutdown = graph_info->m_Shutdown;
+        pthread_mutex_unlock(&graph_info->m_Lock);
+        if(shutdown)
+            break;
+
+        run_worker(worker);
+
+        pthread_mutex_lock(&graph_info->m_Lock);
+        if(++graph_info->m_FinishedCount == graph_info->m_ThreadCount)
+        {
+            pthread_cond_signal(&graph_info->m_DoneCondition);
+        }
+        pthread_mutex_unlock(&graph_info->m_Lock);
+    }
+    return NULL;
+}
+
+// undo everything ape_graph_compile set up
+static void release_schedule(APE_GraphData* graph_info)
+{
+    if(graph_info->m_Workers != NULL)
+    {
+        // worker 0 is whoever calls ape_graph_run, the rest have threads
+        pthread_mutex_lock(&graph_info->m_Lock);
+        graph_info->m_Shutdown = true;
+        pthread_cond_broadcast(&graph_info->m_StartCondition);
+        pthread_mutex_unlock(&graph_info->m_Lock);
+        for(uint32_t thread_index = 0; thread_index < graph_info->m_ThreadCount; ++thread_index)
+        {
+            pthread_join(graph_info->m_Workers[thread_index + 1].m_Thread, NULL);
+        }
+
+        for(uint32_t worker_index = 0; worker_index < graph_info->m_WorkerCount; ++worker_index)
+        {
+            free(graph_info->m_Workers[worker_index].m_Nodes);
+        }
+        free(graph_info->m_Workers);
+    }
+
+    for(uint32_t node = 0; node < array_size(graph_info->m_Nodes); ++node)
+    {
+        APE_GraphNodeData* node_info = get_node(graph_info, node);
+        free(node_info->m_Consumers);
+        node_info->m_Consumers = NULL;
+        node_info->m_ConsumerCount = 0;
+    }
+
+    free(graph_info->m_Buffers);
+    graph_info->m_Workers = NULL;
+    graph_info->m_WorkerCount = 0;
+    graph_info->m_Buffers = NULL;
+    graph_info->m_BufferCount = 0;
+    graph_info->m_ThreadCount = 0;
+    graph_info->m_RunGeneration = 0;
+    graph_info->m_Shutdown = false;
+    graph_info->m_Compiled = false;
+}
+
+APE_Graph ape_graph_create(uint32_t max_block_size)
+{
+    return ape_graph_create_in_context(NULL, max_block_size);
+}
+
+APE_Graph ape_graph_create_in_context(APE_Context context, uint32_t max_block_size)
+{
+    APE_GraphData* graph_info = calloc(1, sizeof(APE_GraphData));
+    if(graph_info == NULL)
+        return NULL;
+
+    graph_info->m_Nodes = array_create(8, false);
+    if(graph_info->m_Nodes == NULL)
+    {
+        free(graph_info);
+        return NULL;
+    }
+    pthread_mutex_init(&graph_info->m_Lock, NULL);
+    pthread_cond_init(&graph_info->m_StartCondition, NULL);
+    pthread_cond_init(&graph_info->m_DoneCondition, NULL);
+
+    if(max_block_size == 0) // dont let stupid be stupid
+        max_block_size = 1;
+
+    // keep every buffer on its own cache lines
+    uint32_t samples_per_line = GRAPH_BUFFER_ALIGNMENT / sizeof(APE_Sample);
+    graph_info->m_MaxBlockSize = ((max_block_size + samples_per_line - 1) / samples_per_line) * samples_per_line;
+    graph_info->m_Context = context;
+    graph_info->m_Check = GRAPH_HEADER_UINT32;
+    return (APE_Graph)graph_info;
+}
+
+void ape_graph_destroy(APE_Graph graph)
+{
+    APE_GraphData* graph_info = (APE_GraphData*)graph;
+    if(!is_valid_graph(graph_info))
+        return;
+
+    release_schedule(graph_info);
+    for(uint32_t node = 0; node < array_size(graph_info->m_Nodes); ++node)
+    {
+        APE_GraphNodeData* node_info = get_node(graph_info, node);
+        for(uint32_t input_index = 0; input_index < array_size(node_info->m_Inputs); ++input_index)
+        {
+            free(array_get(node_info->m_Inputs, input_index));
+        }
+        array_destroy(node_info->m_Inputs);
+        free(node_info->m_Handles);
+        free(node_info->m_Spectrums);
+        free(node_info);
+    }
+    array_destroy(graph_info->m_Nodes);
+    pthread_mutex_destroy(&graph_info->m_Lock);
+    pthread_cond_destroy(&graph_info->m_StartCondition);
+    pthread_cond_destroy(&graph_info->m_DoneCondition);
+    graph_info->m_Check = 0;
+    free(graph_info);
+}
+
+APE_GraphNode ape_graph_add_node(APE_Graph graph, const APE_EqualizerHandle* handles, const APE_FrequencySpectrum* spectrums, uint32_t handle_count)
+{
+    APE_GraphData* graph_info = (APE_GraphData*)graph;
+    if(!is_valid_graph(graph_info))
+        return APE_GRAPH_INVALID_NODE;
+
+    APE_GraphNodeData* node_info = calloc(1, sizeof(APE_GraphNodeData));
+    if(node_info == NULL)
+        return APE_GRAPH_INVALID_NODE;
+
+    node_info->m_HandleCount = handle_count;
+    node_info->m_Handles = malloc(sizeof(APE_EqualizerHandle) * (handle_count + 1));
+    node_info->m_Spectrums = malloc(sizeof(APE_FrequencySpectrum) * (handle_count + 1));
+    node_info->m_Inputs = array_create(2, false);
+    if(node_info->m_Handles == NULL || node_info->m_Spectrums == NULL || node_info->m_Inputs == NULL)
+    {
+        array_destroy(node_info->m_Inputs);
+        free(node_info->m_Handles);
+        free(node_info->m_Spectrums);
+        free(node_info);
+        return APE_GRAPH_INVALID_NODE;
+    }
+    memcpy(node_info->m_Handles, handles, sizeof(APE_EqualizerHandle) * handle_count);
+    memcpy(node_info->m_Spectrums, spectrums, sizeof(APE_FrequencySpectrum) * handle_count);
+
+    APE_GraphNode node = array_size(graph_info->m_Nodes);
+    if(!array_push_back(graph_info->m_Nodes, node_info))
+    {
+        array_destroy(node_info->m_Inputs);
+        free(node_info->m_Handles);
+        free(node_info->m_Spectrums);
+        free(node_info);
+        return APE_GRAPH_INVALID_NODE;
+    }
+
+    release_schedule(graph_info);
+    return node;
+}
+
+bool ape_graph_set_spectrum(APE_Graph graph, APE_GraphNode node, uint32_t handle_index, const APE_FrequencySpectrum* spectrum)
+{
+    APE_GraphData* graph_info = (APE_GraphData*)graph;
+    if(!is_valid_graph(graph_info))
+        return false;
+
+    APE_GraphNodeData* node_info = get_node(graph_info, node);
+    if(node_info == NULL || handle_index >= node_info->m_HandleCount)
+        return false;
+
+    node_info->m_Spectrums[handle_index] = *spectrum;
+    return true;
+}
+
+bool ape_graph_connect(APE_Graph graph, APE_GraphNode source, APE_GraphNode destination, float gain)
+{
+    APE_GraphData* graph_info = (APE_GraphData*)graph;
+    if(!is_valid_graph(graph_info) || source == destination)
+        return false;
+
+    APE_GraphNodeData* destination_info = get_node(graph_info, destination);
+    if(destination_info == NULL || get_node(graph_info, source) == NULL)
+        return false;
+
+    APE_GraphEdge* edge = malloc(sizeof(APE_GraphEdge));
+    if(edge == NULL)
+        return false;
+
+    edge->m_Source = source;
+    edge->m_Gain = gain;
+    if(!array_push_back(destination_info->m_Inputs, edge))
+    {
+        free(edge);
+        return false;
+    }
+
+    release_schedule(graph_info);
+    return true;
+}
+
+bool ape_graph_bind_input(APE_Graph graph, APE_GraphNode node, const APE_Sample* samples)
+{
+    APE_GraphData* graph_info = (APE_GraphData*)graph;
+    if(!is_valid_graph(graph_info))
+        return false;
+
+    APE_GraphNodeData* node_info = get_node(graph_info, node);
+    if(node_info == NULL)
+        return false;
+
+    node_info->m_BoundInput = samples;
+    return true;
+}
+
+bool ape_graph_bind_output(APE_Graph graph, APE_GraphNode node, APE_Sample* samples)
+{
+    APE_GraphData* graph_info = (APE_GraphData*)graph;
+    if(!is_valid_graph(graph_info))
+        return false;
+
+    APE_GraphNodeData* node_info = get_node(graph_info, node);
+    if(node_info == NULL)
+        return false;
+
+    // going between an internal and external buffer changes the buffer assignment
+    if((node_info->m_BoundOutput == NULL) != (samples == NULL))
+    {
+        release_schedule(graph_info);
+    }
+    node_info->m_BoundOutput = samples;
+    return true;
+}
+
+// fills in the consumers of every node and a topological order.  false if there is a cycle
+static bool build_order(APE_GraphData* graph_info, APE_GraphNode* order)
+{
+    uint32_t node_count = array_size(graph_info->m_Nodes);
+    uint32_t* pending = calloc(node_count + 1, sizeof(uint32_t));
+    if(pending == NULL)
+        return false;
+
+    bool success = true;
+    for(uint32_t node = 0; success && node < node_count; ++node)
+    {
+        APE_GraphNodeData* node_info = get_node(graph_info, node);
+        pending[node] = array_size(node_info->m_Inputs);
+        for(uint32_t input_index = 0; input_index < pending[node]; ++input_index)
+        {
+            APE_GraphEdge* edge = array_get(node_info->m_Inputs, input_index);
+            get_node(graph_info, edge->m_Source)->m_ConsumerCount++;
+        }
+    }
+    for(uint32_t node = 0; success && node < node_count; ++node)
+    {
+        APE_GraphNodeData* node_info = get_node(graph_info, node);
+        node_info->m_Consumers = malloc(sizeof(APE_GraphNode) * (node_info->m_ConsumerCount + 1));
+        node_info->m_ConsumerCount = 0;
+        success = node_info->m_Consumers != NULL;
+    }
+    for(uint32_t node = 0; success && node < node_count; ++node)
+    {
+        APE_GraphNodeData* node_info = get_node(graph_info, node);
+        for(uint32_t input_index = 0; input_index < array_size(node_info->m_Inputs); ++input_index)
+        {
+            APE_GraphEdge* edge = array_get(node_info->m_Inputs, input_index);
+            APE_GraphNodeData* source_info = get_node(graph_info, edge->m_Source);
+            source_info->m_Consumers[source_info->m_ConsumerCount++] = node;
+        }
+    }
+
+    // Kahn's algorithm.  order doubles as the queue
+    uint32_t order_size = 0;
+    for(uint32_t node = 0; success && node < node_count; ++node)
+    {
+        if(pending[node] == 0)
+            order[order_size++] = node;
+    }
+    for(uint32_t order_index = 0; success && order_index < order_size; ++order_index)
+    {
+        APE_GraphNodeData* node_info = get_node(graph_info, order[order_index]);
+        for(uint32_t consumer_index = 0; consumer_index < node_info->m_ConsumerCount; ++consumer_index)
+        {
+            APE_GraphNode consumer = node_info->m_Consumers[consumer_index];
+            if(--pending[consumer] == 0)
+                order[order_size++] = consumer;
+        }
+    }
+
+    free(pending);
+    return success && order_size == node_count;
+}
+
+// list scheduling (HLFET).  the ready node furthest from the end of the graph goes to the worker that can start it first
+static bool build_schedule(APE_GraphData* graph_info, const APE_GraphNode* order)
+{
+    uint32_t node_count = array_size(graph_info->m_Nodes);
+    uint32_t worker_count = graph_info->m_WorkerCount;
+    uint32_t* worker_free = calloc(worker_count, sizeof(uint32_t));
+    uint32_t* pending = calloc(node_count + 1, sizeof(uint32_t));
+    uint32_t* ready_time = calloc(node_count + 1, sizeof(uint32_t));
+    bool* scheduled = calloc(node_count + 1, sizeof(bool));
+    bool success = worker_free != NULL && pending != NULL && ready_time != NULL && scheduled != NULL;
+
+    // the cost is a rough count of passes over the block
+    for(uint32_t order_index = node_count; success && order_index > 0; --order_index)
+    {
+        APE_GraphNodeData* node_info = get_node(graph_info, order[order_index - 1]);
+        node_info->m_Cost = 1 + node_info->m_HandleCount + array_size(node_info->m_Inputs);
+        node_info->m_Priority = 0;
+        for(uint32_t consumer_index = 0; consumer_index < node_info->m_ConsumerCount; ++consumer_index)
+        {
+            APE_GraphNodeData* consumer = get_node(graph_info, node_info->m_Consumers[consumer_index]);
+            if(consumer->m_Priority > node_info->m_Priority)
+                node_info->m_Priority = consumer->m_Priority;
+        }
+        node_info->m_Priority += node_info->m_Cost;
+        pending[order[order_index - 1]] = array_size(node_info->m_Inputs);
+    }
+
+    for(uint32_t worker_index = 0; success && worker_index < worker_count; ++worker_index)
+    {
+        APE_GraphWorker* worker = &graph_info->m_Workers[worker_index];
+        worker->m_Graph = graph_info;
+        worker->m_Nodes = malloc(sizeof(APE_GraphNode) * (node_count + 1));
+        success = worker->m_Nodes != NULL;
+    }
+
+    for(uint32_t scheduled_count = 0; success && scheduled_count < node_count; ++scheduled_count)
+    {
+        APE_GraphNode best_node = APE_GRAPH_INVALID_NODE;
+        for(uint32_t node = 0; node < node_count; ++node)
+        {
+            if(!scheduled[node] && pending[node] == 0 &&
+               (best_node == APE_GRAPH_INVALID_NODE || get_node(graph_info, node)->m_Priority > get_node(graph_info, best_node)->m_Priority))
+            {
+                best_node = node;
+            }
+        }
+        assert(best_node != APE_GRAPH_INVALID_NODE && "Scheduling a graph with a cycle.");
+
+        uint32_t best_worker = 0;
+        uint32_t best_start = 0xFFFFFFFF;
+        for(uint32_t worker_index = 0; worker_index < worker_count; ++worker_index)
+        {
+            uint32_t start = worker_free[worker_index] > ready_time[best_node] ? worker_free[worker_index] : ready_time[best_node];
+            if(start < best_start)
+            {
+                best_start = start;
+                best_worker = worker_index;
+            }
+        }
+
+        APE_GraphNodeData* node_info = get_node(graph_info, best_node);
+        APE_GraphWorker* worker = &graph_info->m_Workers[best_worker];
+        node_info->m_Start = best_start;
+        node_info->m_Worker = best_worker;
+        worker->m_Nodes[worker->m_NodeCount++] = best_node;
+        worker_free[best_worker] = best_start + node_info->m_Cost;
+        scheduled[best_node] = true;
+
+        for(uint32_t consumer_index = 0; consumer_index < node_info->m_ConsumerCount; ++consumer_index)
+        {
+            APE_GraphNode consumer = node_info->m_Consumers[consumer_index];
+            pending[consumer]--;
+            if(ready_time[consumer] < worker_free[best_worker])
+                ready_time[consumer] = worker_free[best_worker];
+        }
+    }
+
+    free(worker_free);
+    free(pending);
+    free(ready_time);
+    free(scheduled);
+    return success;
+}
+
+static int compare_start(const void* left, const void* right, void* user_data)
+{
+    APE_GraphData* graph_info = user_data;
+    uint32_t left_start = get_node(graph_info, *(const APE_GraphNode*)left)->m_Start;
+    uint32_t right_start = get_node(graph_info, *(const APE_GraphNode*)right)->m_Start;
+    return (left_start > right_start) - (left_start < right_start);
+}
+
+// two nodes can share a buffer only if everything touching the old contents is guaranteed to finish before the new
+// writer starts.  the guarantee comes from either a graph edge or running earlier on the same worker, so we work out
+// what is reachable through both kinds of edge and hand out buffers in start order
+static bool assign_buffers(APE_GraphData* graph_info, APE_GraphNode* order)
+{
+    uint32_t node_count = array_size(graph_info->m_Nodes);
+    uint32_t words_per_node = (node_count + 63) / 64;
+    uint64_t* reachable = calloc(((size_t)words_per_node * node_count) + 1, sizeof(uint64_t));
+    APE_GraphNode* buffer_writer = malloc(sizeof(APE_GraphNode) * (node_count + 1));
+    if(reachable == NULL || buffer_writer == NULL)
+    {
+        free(reachable);
+        free(buffer_writer);
+        return false;
+    }
+
+    // start order is a topological order of both edge kinds since a node starts after its inputs finish
+    qsort_r(order, node_count, sizeof(APE_GraphNode), compare_start, graph_info);
+
+    APE_GraphNode* next_on_worker = buffer_writer; // borrowed until we start assigning
+    for(uint32_t worker_index = 0; worker_index < graph_info->m_WorkerCount; ++worker_index)
+    {
+        APE_GraphWorker* worker = &graph_info->m_Workers[worker_index];
+        for(uint32_t node_index = 0; node_index < worker->m_NodeCount; ++node_index)
+        {
+            next_on_worker[worker->m_Nodes[node_index]] = node_index + 1 < worker->m_NodeCount ? worker->m_Nodes[node_index + 1] : APE_GRAPH_INVALID_NODE;
+        }
+    }
+    for(uint32_t order_index = node_count; order_index > 0; --order_index)
+    {
+        APE_GraphNode node = order[order_index - 1];
+        APE_GraphNodeData* node_info = get_node(graph_info, node);
+        uint64_t* node_reach = &reachable[(size_t)node * words_per_node];
+        for(uint32_t consumer_index = 0; consumer_index <= node_info->m_ConsumerCount; ++consumer_index)
+        {
+            APE_GraphNode next = consumer_index < node_info->m_ConsumerCount ? node_info->m_Consumers[consumer_index] : next_on_worker[node];
+            if(next == APE_GRAPH_INVALID_NODE)
+                continue;
+
+            const uint64_t* next_reach = &reachable[(size_t)next * words_per_node];
+            node_reach[next / 64] |= 1ull << (next % 64);
+            for(uint32_t word_index = 0; word_index < words_per_node; ++word_index)
+                node_reach[word_index] |= next_reach[word_index];
+        }
+    }
+
+    graph_info->m_BufferCount = 0;
+    for(uint32_t order_index = 0; order_index < node_count; ++order_index)
+    {
+        APE_GraphNode node = order[order_index];
+        APE_GraphNodeData* node_info = get_node(graph_info, node);
+        if(node_info->m_BoundOutput != NULL)
+            continue;
+
+        node_info->m_Buffer = graph_info->m_BufferCount;
+        for(uint32_t buffer_index = 0; buffer_index < graph_info->m_BufferCount; ++buffer_index)
+        {
+            // the last writer and all of its readers have to reach us
+            APE_GraphNodeData* writer_info = get_node(graph_info, buffer_writer[buffer_index]);
+            bool reusable = (reachable[(size_t)buffer_writer[buffer_index] * words_per_node + node / 64] >> (node % 64)) & 1;
+            for(uint32_t consumer_index = 0; reusable && consumer_index < writer_info->m_ConsumerCount; ++consumer_index)
+            {
+                APE_GraphNode reader = writer_info->m_Consumers[consumer_index];
+                reusable = (reachable[(size_t)reader * words_per_node + node / 64] >> (node % 64)) & 1;
+            }
+            if(reusable)
+            {
+                node_info->m_Buffer = buffer_index;
+                break;
+            }
+        }
+
+        if(node_info->m_Buffer == graph_info->m_BufferCount)
+            graph_info->m_BufferCount++;
+        buffer_writer[node_info->m_Buffer] = node;
+    }
+
+    free(reachable);
+    free(buffer_writer);
+
+    if(graph_info->m_BufferCount == 0)
+        return true;
+
+    graph_info->m_Buffers = aligned_alloc(GRAPH_BUFFER_ALIGNMENT, sizeof(APE_Sample) * graph_info->m_MaxBlockSize * graph_info->m_BufferCount);
+    return graph_info->m_Buffers != NULL;
+}
+
+bool ape_graph_compile(APE_Graph graph, uint32_t worker_count)
+{
+    APE_GraphData* graph_info = (APE_GraphData*)graph;
+    if(!is_valid_graph(graph_info))
+        return false;
+
+    release_schedule(graph_info);
+    if(worker_count == 0)
+        worker_count = 1;
+
+    uint32_t node_count = array_size(graph_info->m_Nodes);
+    APE_GraphNode* order = malloc(sizeof(APE_GraphNode) * (node_count + 1));
+    graph_info->m_Workers = calloc(worker_count, sizeof(APE_GraphWorker));
+    if(order == NULL || graph_info->m_Workers == NULL)
+    {
+        free(order);
+        release_schedule(graph_info);
+        return false;
+    }
+    graph_info->m_WorkerCount = worker_count;
+
+    bool success = build_order(graph_info, order) &&
+                   build_schedule(graph_info, order) &&
+                   assign_buffers(graph_info, order);
+    free(order);
+
+    // spin up everyone but worker 0
+    for(uint32_t worker_index = 1; success && worker_index < worker_count; ++worker_index)
+    {
+        APE_GraphWorker* worker = &graph_info->m_Workers[worker_index];
+        success = pthread_create(&worker->m_Thread, NULL, worker_thread, worker) == 0;
+        if(success)
+            graph_info->m_ThreadCount++;
+    }
+
+    if(!success)
+    {
+        release_schedule(graph_info);
+        return false;
+    }
+
+    graph_info->m_Compiled = true;
+    return true;
+}
+
+bool ape_graph_run(APE_Graph graph, uint32_t num_samples)
+{
+    APE_GraphData* graph_info = (APE_GraphData*)graph;
+    if(!is_valid_graph(graph_info) || !graph_info->m_Compiled || num_samples > graph_info->m_MaxBlockSize)
+        return false;
+
+    graph_info->m_RunSamples = num_samples;
+    for(uint32_t node = 0; node < array_size(graph_info->m_Nodes); ++node)
+    {
+        APE_GraphNodeData* node_info = get_node(graph_info, node);
+        atomic_store_explicit(&node_info->m_PendingInputs, array_size(node_info->m_Inputs), memory_order_relaxed);
+    }
+
+    if(graph_info->m_ThreadCount > 0)
+    {
+        pthread_mutex_lock(&graph_info->m_Lock);
+        graph_info->m_FinishedCount = 0;
+        graph_info->m_RunGeneration++;
+        pthread_cond_broadcast(&graph_info->m_StartCondition);
+        pthread_mutex_unlock(&graph_info->m_Lock);
+    }
+
+    run_worker(&graph_info->m_Workers[0]);
+
+    if(graph_info->m_ThreadCount > 0)
+    {
+        pthread_mutex_lock(&graph_info->m_Lock);
+        while(graph_info->m_FinishedCount != graph_info->m_ThreadCount)
+        {
+            pthread_cond_wait(&graph_info->m_DoneCondition, &graph_info->m_Lock);
+        }
+        pthread_mutex_unlock(&graph_info->m_Lock);
+    }
+    return true;
+}
+
+uint32_t ape_graph_buffer_count(APE_Graph graph)
+{
+    APE_GraphData* graph_info = (APE_GraphData*)graph;
+    if(!is_valid_graph(graph_info) || !graph_info->m_Compiled)
+        return 0;
+    return graph_info->m_BufferCount;
+}
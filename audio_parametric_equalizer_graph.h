@@ -0,0 +1,52 @@
+#ifndef AUDIO_PARAMETRIC_EQUALIZER_GRAPH
+#define AUDIO_PARAMETRIC_EQUALIZER_GRAPH
+
+#include "audio_parametric_equalizer.h"
+
+// a DAG of nodes that each mix their inputs and run them through a chain of equalizer handles
+// NOTE: dont obtain or return handles while a graph is running
+typedef void* APE_Graph;
+typedef uint32_t APE_GraphNode;
+
+#define APE_GRAPH_INVALID_NODE 0xFFFFFFFF
+
+// gives you an empty graph
+// in:
+//      max_block_size - the most samples a single ape_graph_run will process
+APE_Graph ape_graph_create(uint32_t max_block_size);
+
+// same as ape_graph_create, for handles from the given context
+APE_Graph ape_graph_create_in_context(APE_Context context, uint32_t max_block_size);
+
+// destroy the graph and stop its workers
+// NOTE: the handles in the graph are not returned
+void ape_graph_destroy(APE_Graph graph);
+
+// add a node that runs handles[0] -> handles[handle_count - 1] in series over the mix of its inputs.  the handles and spectrums are copied
+// returns APE_GRAPH_INVALID_NODE on failure
+APE_GraphNode ape_graph_add_node(APE_Graph graph, const APE_EqualizerHandle* handles, const APE_FrequencySpectrum* spectrums, uint32_t handle_count);
+
+// update the spectrum of one of the node's handles.  takes effect on the next run
+bool ape_graph_set_spectrum(APE_Graph graph, APE_GraphNode node, uint32_t handle_index, const APE_FrequencySpectrum* spectrum);
+
+// mix the output of source into the input of destination, scaled by gain
+bool ape_graph_connect(APE_Graph graph, APE_GraphNode source, APE_GraphNode destination, float gain);
+
+// read an external buffer into the node's mix.  NULL unbinds
+bool ape_graph_bind_input(APE_Graph graph, APE_GraphNode node, const APE_Sample* samples);
+
+// write the node's output to an external buffer instead of an internal one.  NULL unbinds
+bool ape_graph_bind_output(APE_Graph graph, APE_GraphNode node, APE_Sample* samples);
+
+// schedule the graph over worker_count threads (including the one calling ape_graph_run) and assign the internal buffers
+// returns false if the graph has a cycle or the workers couldnt be started
+// NOTE: adding nodes, connecting, or binding/unbinding an output means compiling again.  swapping a bound buffer doesnt
+bool ape_graph_compile(APE_Graph graph, uint32_t worker_count);
+
+// run the whole graph over one block
+bool ape_graph_run(APE_Graph graph, uint32_t num_samples);
+
+// the internal buffers the graph needs after buffer reuse, or 0 if it isnt compiled
+uint32_t ape_graph_buffer_count(APE_Graph graph);
+
+#endif
@@ -0,0 +1,777 @@
+#include "audio_parametric_equalizer_kernels.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// every kernel has to round the same as ape_kernels_filter_scalar, so never fuse a multiply and add into an FMA.
+// clang takes the STDC pragma, gcc ignores it and needs its own, but neither is a promise every compiler keeps
+// NOTE: build this file with -ffp-contract=off (msvc: /fp:precise) so the flag backs the pragmas up
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#else
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+/* Some useful constants. defined in math.h that might not be available to specific systems */
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define APE_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+// environment variable to force a kernel. takes the same names as ape_kernel_name
+#define KERNEL_OVERRIDE_ENV "APE_KERNEL"
+
+// the kernels are read by every filtering thread while ape_set_kernel may be swapping them
+static pthread_once_t _kernels_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t _kernels_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic(APE_Kernel) _active_kernel = APE_KERNEL_SCALAR;
+static _Atomic(APE_FilterLaneKernel) _lane_kernel = NULL;
+static _Atomic(APE_Q15LaneKernel) _q15_lane_kernel = NULL;
+
+static const char* const _kernel_names[APE_KERNEL_COUNT] =
+{
+    "scalar",
+    "sse2",
+    "avx2",
+    "avx512",
+};
+
+void ape_kernels_filter_scalar(APE_FilterState* filter, const APE_Sample* in_samples, APE_Sample* out_samples, uint32_t num_samples)
+{
+    float in_1  = filter->m_RawSamples[0];
+    float in_2  = filter->m_RawSamples[1];
+    float out_1 = filter->m_ProcessedSamples[0];
+    float out_2 = filter->m_ProcessedSamples[1];
+    for(uint32_t sample_index = 0; sample_index < num_samples; ++sample_index)
+    {
+        float in_0  = in_samples[sample_index];
+        float out_0 = (filter->m_B0 * in_0) +
+                      (filter->m_B1 * in_1) +
+                      (filter->m_B2 * in_2) -
+                      (filter->m_A1 * out_1) -
+                      (filter->m_A2 * out_2);
+        out_samples[sample_index] = out_0;
+
+        in_2  = in_1;
+        in_1  = in_0;
+        out_2 = out_1;
+        out_1 = out_0;
+    }
+
+    filter->m_ProcessedSamples[0] = out_1;
+    filter->m_ProcessedSamples[1] = out_2;
+    filter->m_RawSamples[0] = in_1;
+    filter->m_RawSamples[1] = in_2;
+}
+
+// order of the per-lane values gathered for the lane kernels
+enum
+{
+    LANE_B0,
+    LANE_B1,
+    LANE_B2,
+    LANE_A1,
+    LANE_A2,
+    LANE_IN_1,
+    LANE_IN_2,
+    LANE_OUT_1,
+    LANE_OUT_2,
+    LANE_VALUE_COUNT
+};
+
+// unused lanes are left zeroed so they filter silence
+static void gather_lanes(APE_FilterState* const* filters, uint32_t lane_count, float lanes[LANE_VALUE_COUNT][APE_FILTER_LANES])
+{
+    memset(lanes, 0, sizeof(float) * LANE_VALUE_COUNT * APE_FILTER_LANES);
+    for(uint32_t lane_index = 0; lane_index < lane_count; ++lane_index)
+    {
+        const APE_FilterState* filter = filters[lane_index];
+        lanes[LANE_B0][lane_index] = filter->m_B0;
+        lanes[LANE_B1][lane_index] = filter->m_B1;
+        lanes[LANE_B2][lane_index] = filter->m_B2;
+        lanes[LANE_A1][lane_index] = filter->m_A1;
+        lanes[LANE_A2][lane_index] = filter->m_A2;
+        lanes[LANE_IN_1][lane_index] = filter->m_RawSamples[0];
+        lanes[LANE_IN_2][lane_index] = filter->m_RawSamples[1];
+        lanes[LANE_OUT_1][lane_index] = filter->m_ProcessedSamples[0];
+        lanes[LANE_OUT_2][lane_index] = filter->m_ProcessedSamples[1];
+    }
+}
+
+static void scatter_lanes(APE_FilterState* const* filters, uint32_t lane_count, float lanes[LANE_VALUE_COUNT][APE_FILTER_LANES])
+{
+    for(uint32_t lane_index = 0; lane_index < lane_count; ++lane_index)
+    {
+        APE_FilterState* filter = filters[lane_index];
+        filter->m_RawSamples[0] = lanes[LANE_IN_1][lane_index];
+        filter->m_RawSamples[1] = lanes[LANE_IN_2][lane_index];
+        filter->m_ProcessedSamples[0] = lanes[LANE_OUT_1][lane_index];
+        filter->m_ProcessedSamples[1] = lanes[LANE_OUT_2][lane_index];
+    }
+}
+
+// the lane's input at sample_index, with the unused lanes silent.  for the samples that dont fill a transpose
+static inline void load_lane_column(const APE_Sample* const* in_samples, uint32_t lane_count, uint32_t sample_index, float column[APE_FILTER_LANES])
+{
+    for(uint32_t lane_index = 0; lane_index < APE_FILTER_LANES; ++lane_index)
+        column[lane_index] = lane_index < lane_count ? in_samples[lane_index][sample_index] : 0.0f;
+}
+
+static inline void store_lane_column(APE_Sample* const* out_samples, uint32_t lane_count, uint32_t sample_index, const float column[APE_FILTER_LANES])
+{
+    for(uint32_t lane_index = 0; lane_index < lane_count; ++lane_index)
+        out_samples[lane_index][sample_index] = column[lane_index];
+}
+
+// without vectors there is nothing to gain from packing the lanes together
+static void filter_lanes_scalar(APE_FilterState* const* filters, uint32_t lane_count, const APE_Sample* const* in_samples, APE_Sample* const* out_samples, uint32_t num_samples)
+{
+    for(uint32_t lane_index = 0; lane_index < lane_count; ++lane_index)
+    {
+        ape_kernels_filter_scalar(filters[lane_index], in_samples[lane_index], out_samples[lane_index], num_samples);
+    }
+}
+
+static inline int16_t q15_saturate(int32_t value)
+{
+    return value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : (int16_t)value);
+}
+
+// the same as pmulhrsw, including -1 * -1 wrapping to -1
+static inline int16_t q15_multiply(int16_t left, int16_t right)
+{
+    return (int16_t)((((int32_t)left * right) + 0x4000) >> 15);
+}
+
+// every step is a saturating 16 bit op so the vector kernels can match it exactly
+static void filter_q15_strided(APE_FixedState* fixed, const int16_t* in_samples, int16_t* out_samples, uint32_t num_samples, uint32_t stride)
+{
+    int16_t b0 = fixed->m_B0;
+    int16_t b1 = fixed->m_B1;
+    int16_t b2 = fixed->m_B2;
+    int16_t a1 = fixed->m_A1;
+    int16_t a2 = fixed->m_A2;
+    int16_t in_1  = fixed->m_RawSamples[0];
+    int16_t in_2  = fixed->m_RawSamples[1];
+    int16_t out_1 = fixed->m_ProcessedSamples[0];
+    int16_t out_2 = fixed->m_ProcessedSamples[1];
+    for(uint32_t sample_index = 0; sample_index < num_samples; ++sample_index)
+    {
+        int16_t in_0  = in_samples[sample_index * stride];
+        int16_t out_0 = q15_saturate(q15_multiply(b0, in_0) + q15_multiply(b1, in_1));
+        out_0 = q15_saturate(out_0 + q15_multiply(b2, in_2));
+        out_0 = q15_saturate(out_0 - q15_multiply(a1, out_1));
+        out_0 = q15_saturate(out_0 - q15_multiply(a2, out_2));
+        for(int32_t shift_index = 0; shift_index < fixed->m_Shift; ++shift_index)
+            out_0 = q15_saturate(out_0 + out_0);
+        out_samples[sample_index * stride] = out_0;
+
+        in_2  = in_1;
+        in_1  = in_0;
+        out_2 = out_1;
+        out_1 = out_0;
+    }
+
+    fixed->m_ProcessedSamples[0] = out_1;
+    fixed->m_ProcessedSamples[1] = out_2;
+    fixed->m_RawSamples[0] = in_1;
+    fixed->m_RawSamples[1] = in_2;
+}
+
+static void filter_q15_lanes_scalar(APE_FixedState* const* states, uint32_t lane_count, const int16_t* in_samples, int16_t* out_samples, uint32_t num_samples)
+{
+    for(uint32_t lane_index = 0; lane_index < lane_count; ++lane_index)
+    {
+        filter_q15_strided(states[lane_index], &in_samples[lane_index], &out_samples[lane_index], num_samples, APE_Q15_LANES);
+    }
+}
+
+#ifdef APE_KERNELS_X86
+
+// the vector lane kernels load a few samples from each lane, transpose them so a register holds one sample of every
+// lane, and step the recursion of all the lanes at once in the same operation order as ape_kernels_filter_scalar
+
+__attribute__((target("sse2")))
+static inline __m128 lane_step_sse2(__m128 wide[LANE_VALUE_COUNT], __m128 in_0)
+{
+    __m128 out_0 = _mm_add_ps(_mm_mul_ps(wide[LANE_B0], in_0), _mm_mul_ps(wide[LANE_B1], wide[LANE_IN_1]));
+    out_0 = _mm_add_ps(out_0, _mm_mul_ps(wide[LANE_B2], wide[LANE_IN_2]));
+    out_0 = _mm_sub_ps(out_0, _mm_mul_ps(wide[LANE_A1], wide[LANE_OUT_1]));
+    out_0 = _mm_sub_ps(out_0, _mm_mul_ps(wide[LANE_A2], wide[LANE_OUT_2]));
+    wide[LANE_IN_2]  = wide[LANE_IN_1];
+    wide[LANE_IN_1]  = in_0;
+    wide[LANE_OUT_2] = wide[LANE_OUT_1];
+    wide[LANE_OUT_1] = out_0;
+    return out_0;
+}
+
+__attribute__((target("sse2")))
+static void filter_lanes_sse2(APE_FilterState* const* filters, uint32_t lane_count, const APE_Sample* const* in_samples, APE_Sample* const* out_samples, uint32_t num_samples)
+{
+    float lanes[LANE_VALUE_COUNT][APE_FILTER_LANES];
+    gather_lanes(filters, lane_count, lanes);
+    const uint32_t group_count = (lane_count + 3) / 4;
+    __m128 wide[APE_FILTER_LANES / 4][LANE_VALUE_COUNT];
+    for(uint32_t group_index = 0; group_index < group_count; ++group_index)
+        for(uint32_t value_index = 0; value_index < LANE_VALUE_COUNT; ++value_index)
+            wide[group_index][value_index] = _mm_loadu_ps(&lanes[value_index][group_index * 4]);
+
+    uint32_t sample_index = 0;
+    for(; sample_index + 4 <= num_samples; sample_index += 4)
+    {
+        for(uint32_t group_index = 0; group_index < group_count; ++group_index)
+        {
+            uint32_t lane_start = group_index * 4;
+            __m128 rows[4];
+            for(uint32_t row_index = 0; row_index < 4; ++row_index)
+                rows[row_index] = lane_start + row_index < lane_count ? _mm_loadu_ps(&in_samples[lane_start + row_index][sample_index]) : _mm_setzero_ps();
+            _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+            for(uint32_t row_index = 0; row_index < 4; ++row_index)
+                rows[row_index] = lane_step_sse2(wide[group_index], rows[row_index]);
+            _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+            for(uint32_t row_index = 0; row_index < 4 && lane_start + row_index < lane_count; ++row_index)
+                _mm_storeu_ps(&out_samples[lane_start + row_index][sample_index], rows[row_index]);
+        }
+    }
+    for(; sample_index < num_samples; ++sample_index)
+    {
+        float column[APE_FILTER_LANES];
+        load_lane_column(in_samples, lane_count, sample_index, column);
+        for(uint32_t group_index = 0; group_index < group_count; ++group_index)
+            _mm_storeu_ps(&column[group_index * 4], lane_step_sse2(wide[group_index], _mm_loadu_ps(&column[group_index * 4])));
+        store_lane_column(out_samples, lane_count, sample_index, column);
+    }
+
+    for(uint32_t group_index = 0; group_index < group_count; ++group_index)
+        for(uint32_t value_index = LANE_IN_1; value_index < LANE_VALUE_COUNT; ++value_index)
+            _mm_storeu_ps(&lanes[value_index][group_index * 4], wide[group_index][value_index]);
+    scatter_lanes(filters, lane_count, lanes);
+}
+
+__attribute__((target("avx2")))
+static inline void transpose8_avx2(__m256 rows[8])
+{
+    __m256 low_0  = _mm256_unpacklo_ps(rows[0], rows[1]);
+    __m256 high_0 = _mm256_unpackhi_ps(rows[0], rows[1]);
+    __m256 low_1  = _mm256_unpacklo_ps(rows[2], rows[3]);
+    __m256 high_1 = _mm256_unpackhi_ps(rows[2], rows[3]);
+    __m256 low_2  = _mm256_unpacklo_ps(rows[4], rows[5]);
+    __m256 high_2 = _mm256_unpackhi_ps(rows[4], rows[5]);
+    __m256 low_3  = _mm256_unpacklo_ps(rows[6], rows[7]);
+    __m256 high_3 = _mm256_unpackhi_ps(rows[6], rows[7]);
+    __m256 quad_0 = _mm256_shuffle_ps(low_0, low_1, 0x44);
+    __m256 quad_1 = _mm256_shuffle_ps(low_0, low_1, 0xEE);
+    __m256 quad_2 = _mm256_shuffle_ps(high_0, high_1, 0x44);
+    __m256 quad_3 = _mm256_shuffle_ps(high_0, high_1, 0xEE);
+    __m256 quad_4 = _mm256_shuffle_ps(low_2, low_3, 0x44);
+    __m256 quad_5 = _mm256_shuffle_ps(low_2, low_3, 0xEE);
+    __m256 quad_6 = _mm256_shuffle_ps(high_2, high_3, 0x44);
+    __m256 quad_7 = _mm256_shuffle_ps(high_2, high_3, 0xEE);
+    rows[0] = _mm256_permute2f128_ps(quad_0, quad_4, 0x20);
+    rows[1] = _mm256_permute2f128_ps(quad_1, quad_5, 0x20);
+    rows[2] = _mm256_permute2f128_ps(quad_2, quad_6, 0x20);
+    rows[3] = _mm256_permute2f128_ps(quad_3, quad_7, 0x20);
+    rows[4] = _mm256_permute2f128_ps(quad_0, quad_4, 0x31);
+    rows[5] = _mm256_permute2f128_ps(quad_1, quad_5, 0x31);
+    rows[6] = _mm256_permute2f128_ps(quad_2, quad_6, 0x31);
+    rows[7] = _mm256_permute2f128_ps(quad_3, quad_7, 0x31);
+}
+
+// 8 samples of 8 lanes starting at lane_start, with the unused lanes silent
+__attribute__((target("avx2")))
+static inline void load_rows_avx2(const APE_Sample* const* in_samples, uint32_t lane_count, uint32_t lane_start, uint32_t sample_index, __m256 rows[8])
+{
+    for(uint32_t row_index = 0; row_index < 8; ++row_index)
+        rows[row_index] = lane_start + row_index < lane_count ? _mm256_loadu_ps(&in_samples[lane_start + row_index][sample_index]) : _mm256_setzero_ps();
+    transpose8_avx2(rows);
+}
+
+__attribute__((target("avx2")))
+static inline void store_rows_avx2(APE_Sample* const* out_samples, uint32_t lane_count, uint32_t lane_start, uint32_t sample_index, __m256 rows[8])
+{
+    transpose8_avx2(rows);
+    for(uint32_t row_index = 0; row_index < 8 && lane_start + row_index < lane_count; ++row_index)
+        _mm256_storeu_ps(&out_samples[lane_start + row_index][sample_index], rows[row_index]);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 lane_step_avx2(__m256 wide[LANE_VALUE_COUNT], __m256 in_0)
+{
+    __m256 out_0 = _mm256_add_ps(_mm256_mul_ps(wide[LANE_B0], in_0), _mm256_mul_ps(wide[LANE_B1], wide[LANE_IN_1]));
+    out_0 = _mm256_add_ps(out_0, _mm256_mul_ps(wide[LANE_B2], wide[LANE_IN_2]));
+    out_0 = _mm256_sub_ps(out_0, _mm256_mul_ps(wide[LANE_A1], wide[LANE_OUT_1]));
+    out_0 = _mm256_sub_ps(out_0, _mm256_mul_ps(wide[LANE_A2], wide[LANE_OUT_2]));
+    wide[LANE_IN_2]  = wide[LANE_IN_1];
+    wide[LANE_IN_1]  = in_0;
+    wide[LANE_OUT_2] = wide[LANE_OUT_1];
+    wide[LANE_OUT_1] = out_0;
+    return out_0;
+}
+
+__attribute__((target("avx2")))
+static void filter_lanes_avx2(APE_FilterState* const* filters, uint32_t lane_count, const APE_Sample* const* in_samples, APE_Sample* const* out_samples, uint32_t num_samples)
+{
+    float lanes[LANE_VALUE_COUNT][APE_FILTER_LANES];
+    gather_lanes(filters, lane_count, lanes);
+    const uint32_t group_count = (lane_count + 7) / 8;
+    __m256 wide[APE_FILTER_LANES / 8][LANE_VALUE_COUNT];
+    for(uint32_t group_index = 0; group_index < group_count; ++group_index)
+        for(uint32_t value_index = 0; value_index < LANE_VALUE_COUNT; ++value_index)
+            wide[group_index][value_index] = _mm256_loadu_ps(&lanes[value_index][group_index * 8]);
+
+    uint32_t sample_index = 0;
+    for(; sample_index + 8 <= num_samples; sample_index += 8)
+    {
+        for(uint32_t group_index = 0; group_index < group_count; ++group_index)
+        {
+            __m256 rows[8];
+            load_rows_avx2(in_samples, lane_count, group_index * 8, sample_index, rows);
+            for(uint32_t row_index = 0; row_index < 8; ++row_index)
+                rows[row_index] = lane_step_avx2(wide[group_index], rows[row_index]);
+            store_rows_avx2(out_samples, lane_count, group_index * 8, sample_index, rows);
+        }
+    }
+    for(; sample_index < num_samples; ++sample_index)
+    {
+        float column[APE_FILTER_LANES];
+        load_lane_column(in_samples, lane_count, sample_index, column);
+        for(uint32_t group_index = 0; group_index < group_count; ++group_index)
+            _mm256_storeu_ps(&column[group_index * 8], lane_step_avx2(wide[group_index], _mm256_loadu_ps(&column[group_index * 8])));
+        store_lane_column(out_samples, lane_count, sample_index, column);
+    }
+
+    for(uint32_t group_index = 0; group_index < group_count; ++group_index)
+        for(uint32_t value_index = LANE_IN_1; value_index < LANE_VALUE_COUNT; ++value_index)
+            _mm256_storeu_ps(&lanes[value_index][group_index * 8], wide[group_index][value_index]);
+    scatter_lanes(filters, lane_count, lanes);
+}
+
+// all 16 lanes in one register.  the transpose is done as two 8x8 halves
+__attribute__((target("avx512f")))
+static void filter_lanes_avx512(APE_FilterState* const* filters, uint32_t lane_count, const APE_Sample* const* in_samples, APE_Sample* const* out_samples, uint32_t num_samples)
+{
+    float lanes[LANE_VALUE_COUNT][APE_FILTER_LANES];
+    gather_lanes(filters, lane_count, lanes);
+    __m512 wide[LANE_VALUE_COUNT];
+    for(uint32_t value_index = 0; value_index < LANE_VALUE_COUNT; ++value_index)
+        wide[value_index] = _mm512_loadu_ps(lanes[value_index]);
+
+    uint32_t sample_index = 0;
+    for(; sample_index + 8 <= num_samples; sample_index += 8)
+    {
+        __m256 low_rows[8];
+        __m256 high_rows[8];
+        load_rows_avx2(in_samples, lane_count, 0, sample_index, low_rows);
+        load_rows_avx2(in_samples, lane_count, 8, sample_index, high_rows);
+        for(uint32_t row_index = 0; row_index < 8; ++row_index)
+        {
+            __m512 in_0 = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castpd256_pd512(_mm256_castps_pd(low_rows[row_index])), _mm256_castps_pd(high_rows[row_index]), 1));
+            __m512 out_0 = _mm512_add_ps(_mm512_mul_ps(wide[LANE_B0], in_0), _mm512_mul_ps(wide[LANE_B1], wide[LANE_IN_1]));
+            out_0 = _mm512_add_ps(out_0, _mm512_mul_ps(wide[LANE_B2], wide[LANE_IN_2]));
+            out_0 = _mm512_sub_ps(out_0, _mm512_mul_ps(wide[LANE_A1], wide[LANE_OUT_1]));
+            out_0 = _mm512_sub_ps(out_0, _mm512_mul_ps(wide[LANE_A2], wide[LANE_OUT_2]));
+            wide[LANE_IN_2]  = wide[LANE_IN_1];
+            wide[LANE_IN_1]  = in_0;
+            wide[LANE_OUT_2] = wide[LANE_OUT_1];
+            wide[LANE_OUT_1] = out_0;
+            low_rows[row_index]  = _mm512_castps512_ps256(out_0);
+            high_rows[row_index] = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(out_0), 1));
+        }
+        store_rows_avx2(out_samples, lane_count, 0, sample_index, low_rows);
+        store_rows_avx2(out_samples, lane_count, 8, sample_index, high_rows);
+    }
+    for(; sample_index < num_samples; ++sample_index)
+    {
+        float column[APE_FILTER_LANES];
+        load_lane_column(in_samples, lane_count, sample_index, column);
+        __m512 in_0 = _mm512_loadu_ps(column);
+        __m512 out_0 = _mm512_add_ps(_mm512_mul_ps(wide[LANE_B0], in_0), _mm512_mul_ps(wide[LANE_B1], wide[LANE_IN_1]));
+        out_0 = _mm512_add_ps(out_0, _mm512_mul_ps(wide[LANE_B2], wide[LANE_IN_2]));
+        out_0 = _mm512_sub_ps(out_0, _mm512_mul_ps(wide[LANE_A1], wide[LANE_OUT_1]));
+        out_0 = _mm512_sub_ps(out_0, _mm512_mul_ps(wide[LANE_A2], wide[LANE_OUT_2]));
+        wide[LANE_IN_2]  = wide[LANE_IN_1];
+        wide[LANE_IN_1]  = in_0;
+        wide[LANE_OUT_2] = wide[LANE_OUT_1];
+        wide[LANE_OUT_1] = out_0;
+        _mm512_storeu_ps(column, out_0);
+        store_lane_column(out_samples, lane_count, sample_index, column);
+    }
+
+    for(uint32_t value_index = LANE_IN_1; value_index < LANE_VALUE_COUNT; ++value_index)
+        _mm512_storeu_ps(lanes[value_index], wide[value_index]);
+    scatter_lanes(filters, lane_count, lanes);
+}
+
+// one section per 16 bit lane.  the shift differs per lane so the doubling is masked
+__attribute__((target("avx2")))
+static void filter_q15_lanes_avx2(APE_FixedState* const* states, uint32_t lane_count, const int16_t* in_samples, int16_t* out_samples, uint32_t num_samples)
+{
+    int16_t lanes[10][APE_Q15_LANES];
+    memset(lanes, 0, sizeof(lanes));
+    int32_t max_shift = 0;
+    for(uint32_t lane_index = 0; lane_index < lane_count; ++lane_index)
+    {
+        const APE_FixedState* fixed = states[lane_index];
+        lanes[0][lane_index] = fixed->m_B0;
+        lanes[1][lane_index] = fixed->m_B1;
+        lanes[2][lane_index] = fixed->m_B2;
+        lanes[3][lane_index] = fixed->m_A1;
+        lanes[4][lane_index] = fixed->m_A2;
+        lanes[5][lane_index] = fixed->m_Shift;
+        lanes[6][lane_index] = fixed->m_RawSamples[0];
+        lanes[7][lane_index] = fixed->m_RawSamples[1];
+        lanes[8][lane_index] = fixed->m_ProcessedSamples[0];
+        lanes[9][lane_index] = fixed->m_ProcessedSamples[1];
+        if(fixed->m_Shift > max_shift)
+            max_shift = fixed->m_Shift;
+    }
+
+    __m256i b0 = _mm256_loadu_si256((const __m256i*)lanes[0]);
+    __m256i b1 = _mm256_loadu_si256((const __m256i*)lanes[1]);
+    __m256i b2 = _mm256_loadu_si256((const __m256i*)lanes[2]);
+    __m256i a1 = _mm256_loadu_si256((const __m256i*)lanes[3]);
+    __m256i a2 = _mm256_loadu_si256((const __m256i*)lanes[4]);
+    __m256i shift = _mm256_loadu_si256((const __m256i*)lanes[5]);
+    __m256i in_1  = _mm256_loadu_si256((const __m256i*)lanes[6]);
+    __m256i in_2  = _mm256_loadu_si256((const __m256i*)lanes[7]);
+    __m256i out_1 = _mm256_loadu_si256((const __m256i*)lanes[8]);
+    __m256i out_2 = _mm256_loadu_si256((const __m256i*)lanes[9]);
+    for(uint32_t sample_index = 0; sample_index < num_samples; ++sample_index)
+    {
+        __m256i in_0  = _mm256_loadu_si256((const __m256i*)&in_samples[sample_index * APE_Q15_LANES]);
+        __m256i out_0 = _mm256_adds_epi16(_mm256_mulhrs_epi16(b0, in_0), _mm256_mulhrs_epi16(b1, in_1));
+        out_0 = _mm256_adds_epi16(out_0, _mm256_mulhrs_epi16(b2, in_2));
+        out_0 = _mm256_subs_epi16(out_0, _mm256_mulhrs_epi16(a1, out_1));
+        out_0 = _mm256_subs_epi16(out_0, _mm256_mulhrs_epi16(a2, out_2));
+        for(int32_t shift_index = 0; shift_index < max_shift; ++shift_index)
+        {
+            __m256i lane_mask = _mm256_cmpgt_epi16(shift, _mm256_set1_epi16(shift_index));
+            out_0 = _mm256_blendv_epi8(out_0, _mm256_adds_epi16(out_0, out_0), lane_mask);
+        }
+        _mm256_storeu_si256((__m256i*)&out_samples[sample_index * APE_Q15_LANES], out_0);
+
+        in_2  = in_1;
+        in_1  = in_0;
+        out_2 = out_1;
+        out_1 = out_0;
+    }
+
+    _mm256_storeu_si256((__m256i*)lanes[6], in_1);
+    _mm256_storeu_si256((__m256i*)lanes[7], in_2);
+    _mm256_storeu_si256((__m256i*)lanes[8], out_1);
+    _mm256_storeu_si256((__m256i*)lanes[9], out_2);
+    for(uint32_t lane_index = 0; lane_index < lane_count; ++lane_index)
+    {
+        APE_FixedState* fixed = states[lane_index];
+        fixed->m_RawSamples[0] = lanes[6][lane_index];
+        fixed->m_RawSamples[1] = lanes[7][lane_index];
+        fixed->m_ProcessedSamples[0] = lanes[8][lane_index];
+        fixed->m_ProcessedSamples[1] = lanes[9][lane_index];
+    }
+}
+
+#endif // APE_KERNELS_X86
+
+static bool kernel_supported(APE_Kernel kernel)
+{
+    switch(kernel)
+    {
+    case APE_KERNEL_SCALAR:
+        return true;
+#ifdef APE_KERNELS_X86
+    case APE_KERNEL_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case APE_KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case APE_KERNEL_AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+// NOTE: each pointer is swapped on its own, so a thread filtering during the swap may pair the old float lane kernel
+//       with the new Q15 one.  every kernel gives the same output so that is harmless
+static void apply_kernel(APE_Kernel kernel)
+{
+    APE_FilterLaneKernel lane_kernel = filter_lanes_scalar;
+    APE_Q15LaneKernel q15_lane_kernel = filter_q15_lanes_scalar;
+    switch(kernel)
+    {
+#ifdef APE_KERNELS_X86
+    case APE_KERNEL_SSE2:
+        lane_kernel = filter_lanes_sse2;
+        break;
+    case APE_KERNEL_AVX2:
+        lane_kernel = filter_lanes_avx2;
+        q15_lane_kernel = filter_q15_lanes_avx2;
+        break;
+    case APE_KERNEL_AVX512:
+        lane_kernel = filter_lanes_avx512;
+        q15_lane_kernel = filter_q15_lanes_avx2;
+        break;
+#endif
+    default:
+        kernel = APE_KERNEL_SCALAR;
+        break;
+    }
+
+    pthread_mutex_lock(&_kernels_lock);
+    atomic_store_explicit(&_lane_kernel, lane_kernel, memory_order_release);
+    atomic_store_explicit(&_q15_lane_kernel, q15_lane_kernel, memory_order_release);
+    atomic_store_explicit(&_active_kernel, kernel, memory_order_release);
+    pthread_mutex_unlock(&_kernels_lock);
+}
+
+static void init_kernels()
+{
+#ifdef APE_KERNELS_X86
+    __builtin_cpu_init();
+#endif
+
+    // start with the widest we have, up to avx2.  the avx512 lane kernel measured no faster than avx2 (the transposes
+    // and the recursion's latency bound it, not the width), so it has to be asked for
+    APE_Kernel kernel = APE_KERNEL_SCALAR;
+    for(int32_t kernel_index = APE_KERNEL_AVX2; kernel_index >= 0; --kernel_index)
+    {
+        if(kernel_supported((APE_Kernel)kernel_index))
+        {
+            kernel = (APE_Kernel)kernel_index;
+            break;
+        }
+    }
+
+    // let the environment force one for testing.  ignored if this cpu cant run it
+    const char* kernel_override = getenv(KERNEL_OVERRIDE_ENV);
+    if(kernel_override != NULL)
+    {
+        for(uint32_t kernel_index = 0; kernel_index < APE_KERNEL_COUNT; ++kernel_index)
+        {
+            if(strcmp(kernel_override, _kernel_names[kernel_index]) == 0 && kernel_supported((APE_Kernel)kernel_index))
+            {
+                kernel = (APE_Kernel)kernel_index;
+                break;
+            }
+        }
+    }
+
+    apply_kernel(kernel);
+}
+
+void ape_kernels_init()
+{
+    pthread_once(&_kernels_once, init_kernels);
+}
+
+APE_FilterLaneKernel ape_kernels_filter_lanes()
+{
+    ape_kernels_init();
+    return atomic_load_explicit(&_lane_kernel, memory_order_acquire);
+}
+
+APE_Q15LaneKernel ape_kernels_filter_q15_lanes()
+{
+    ape_kernels_init();
+    return atomic_load_explicit(&_q15_lane_kernel, memory_order_acquire);
+}
+
+void ape_kernels_coefficients(const APE_FrequencySpectrum* frequncy_sample, APE_SectionCoefficients* coefficients)
+{
+    // Maths based on https://8void.files.wordpress.com/2017/11/orfanidis.pdf
+    double gb_calc_0 = pow(10.0, frequncy_sample->m_BandwidthGain / 20.0);
+    double g0_calc_0 = pow(10.0, frequncy_sample->m_ReferenceGain / 20.0);
+    double g_calc_0  = pow(10.0, frequncy_sample->m_GainAdjustment / 20.0);
+    double gb_calc_1 = gb_calc_0 * gb_calc_0;
+    double g0_calc_1 = g0_calc_0 * g0_calc_0;
+    double g_calc_1  = g_calc_0 * g_calc_0;
+    double fs_half   = frequncy_sample->m_SampleRate / 2.0;
+
+    double beta = tan(frequncy_sample->m_Bandwidth / 2.0 * M_PI / fs_half) *
+                  sqrt(fabs(gb_calc_1 - g0_calc_1)) / sqrt(fabs(0.001 + g_calc_1 - gb_calc_1));
+
+    double beta_p = 1.0 + beta;
+    double beta_m = 1.0 - beta;
+    double f0_cos_x2 = -2.0 * cos(frequncy_sample->m_Frequency * M_PI / fs_half) / beta_p;
+
+    coefficients->m_B0 = (g0_calc_0 + g_calc_0 * beta) / beta_p;
+    coefficients->m_B1 =  g0_calc_0 * f0_cos_x2;
+    coefficients->m_B2 = (g0_calc_0 - g_calc_0 * beta) / beta_p;
+    coefficients->m_A1 = f0_cos_x2;
+    coefficients->m_A2 = beta_m / beta_p;
+}
+
+// the Q31 accumulator adds 5 products of a coefficient and a sample of at most 2^31 in magnitude, plus an error under
+// 2^30.  keeping the coefficients' magnitudes summed to at most this keeps every partial sum under 2^63
+#define Q31_COEFFICIENT_SUM_LIMIT ((1ll << 32) - 2)
+
+// smallest power of 2 that every coefficient is under
+static int32_t coefficient_shift(const APE_SectionCoefficients* coefficients, int32_t max_shift)
+{
+    double largest = fabs(coefficients->m_B0);
+    largest = fmax(largest, fabs(coefficients->m_B1));
+    largest = fmax(largest, fabs(coefficients->m_B2));
+    largest = fmax(largest, fabs(coefficients->m_A1));
+    largest = fmax(largest, fabs(coefficients->m_A2));
+
+    int32_t shift = 0;
+    while(shift < max_shift && largest >= ldexp(1.0, shift))
+        shift++;
+    return shift;
+}
+
+static int64_t coefficient_magnitude_sum(const APE_FixedState* fixed)
+{
+    return llabs((int64_t)fixed->m_B0) + llabs((int64_t)fixed->m_B1) + llabs((int64_t)fixed->m_B2) +
+           llabs((int64_t)fixed->m_A1) + llabs((int64_t)fixed->m_A2);
+}
+
+static int32_t quantize(double value, double scale, int64_t limit)
+{
+    int64_t quantized = llrint(value * scale);
+    return (int32_t)(quantized > limit ? limit : (quantized < -limit - 1 ? -limit - 1 : quantized));
+}
+
+static void quantize_coefficients(APE_FixedState* fixed, const APE_SectionCoefficients* coefficients, double scale, int64_t limit)
+{
+    fixed->m_B0 = quantize(coefficients->m_B0, scale, limit);
+    fixed->m_B1 = quantize(coefficients->m_B1, scale, limit);
+    fixed->m_B2 = quantize(coefficients->m_B2, scale, limit);
+    fixed->m_A1 = quantize(coefficients->m_A1, scale, limit);
+    fixed->m_A2 = quantize(coefficients->m_A2, scale, limit);
+}
+
+void ape_fixed_quantize(APE_FixedState* fixed, const APE_SectionCoefficients* coefficients, APE_Engine engine)
+{
+    // Q15 saturates every step so it only needs each coefficient to fit
+    if(engine == APE_ENGINE_Q15)
+    {
+        fixed->m_Shift = coefficient_shift(coefficients, 15);
+        quantize_coefficients(fixed, coefficients, ldexp(1.0, 15 - fixed->m_Shift), INT16_MAX);
+        return;
+    }
+
+    // Q31 has to keep the accumulator from overflowing, which depends on the sum of the coefficients not the largest.
+    // the shift tops out at 30 where the coefficients are plain integers, so only a section with coefficients summing
+    // past 2^32 could fail, and no peaking section comes anywhere near that
+    fixed->m_Shift = coefficient_shift(coefficients, 30);
+    quantize_coefficients(fixed, coefficients, ldexp(1.0, 30 - fixed->m_Shift), INT32_MAX);
+    while(fixed->m_Shift < 30 && coefficient_magnitude_sum(fixed) > Q31_COEFFICIENT_SUM_LIMIT)
+    {
+        fixed->m_Shift++;
+        quantize_coefficients(fixed, coefficients, ldexp(1.0, 30 - fixed->m_Shift), INT32_MAX);
+    }
+    assert(coefficient_magnitude_sum(fixed) <= Q31_COEFFICIENT_SUM_LIMIT && "Section is too large for the Q31 engine.");
+}
+
+static bool fits_q15(int32_t value)
+{
+    return value >= INT16_MIN && value <= INT16_MAX;
+}
+
+bool ape_fixed_state_valid(const APE_FixedState* fixed, APE_Engine engine)
+{
+    if(engine == APE_ENGINE_Q15)
+    {
+        return  fixed->m_Shift >= 0 && fixed->m_Shift <= 15 &&
+                fits_q15(fixed->m_B0) && fits_q15(fixed->m_B1) && fits_q15(fixed->m_B2) &&
+                fits_q15(fixed->m_A1) && fits_q15(fixed->m_A2) &&
+                fits_q15(fixed->m_RawSamples[0]) && fits_q15(fixed->m_RawSamples[1]) &&
+                fits_q15(fixed->m_ProcessedSamples[0]) && fits_q15(fixed->m_ProcessedSamples[1]);
+    }
+
+    // the error is what flooring dropped, so it sits under one unit of the coefficients' fraction
+    return  engine == APE_ENGINE_Q31 &&
+            fixed->m_Shift >= 0 && fixed->m_Shift <= 30 &&
+            coefficient_magnitude_sum(fixed) <= Q31_COEFFICIENT_SUM_LIMIT &&
+            fixed->m_Error >= 0 && fixed->m_Error < ((int64_t)1 << (30 - fixed->m_Shift));
+}
+
+void ape_fixed_filter_q31(APE_FixedState* fixed, const int32_t* in_samples, int32_t* out_samples, uint32_t num_samples)
+{
+    // ape_fixed_quantize keeps the coefficients' magnitudes summed under 2^32, so with samples of at most 2^31 and an
+    // error under 2^30 no partial sum reaches 2^63
+    const uint32_t fraction_bits = 30 - fixed->m_Shift;
+    const int64_t fraction_one = (int64_t)1 << fraction_bits;
+    int64_t error = fixed->m_Error;
+    int32_t in_1  = fixed->m_RawSamples[0];
+    int32_t in_2  = fixed->m_RawSamples[1];
+    int32_t out_1 = fixed->m_ProcessedSamples[0];
+    int32_t out_2 = fixed->m_ProcessedSamples[1];
+    for(uint32_t sample_index = 0; sample_index < num_samples; ++sample_index)
+    {
+        int32_t in_0 = in_samples[sample_index];
+        int64_t accumulator = ((int64_t)fixed->m_B0 * in_0) +
+                              ((int64_t)fixed->m_B1 * in_1) +
+                              ((int64_t)fixed->m_B2 * in_2) -
+                              ((int64_t)fixed->m_A1 * out_1) -
+                              ((int64_t)fixed->m_A2 * out_2) +
+                              error;
+
+        // floor to Q31 and carry what we dropped into the next sample, which pushes the noise away from DC
+        int64_t out_wide = accumulator >> fraction_bits;
+        error = accumulator - (out_wide * fraction_one);
+        int32_t out_0;
+        if(out_wide > INT32_MAX)
+        {
+            out_0 = INT32_MAX;
+            error = 0;
+        }
+        else if(out_wide < INT32_MIN)
+        {
+            out_0 = INT32_MIN;
+            error = 0;
+        }
+        else
+        {
+            out_0 = (int32_t)out_wide;
+        }
+        out_samples[sample_index] = out_0;
+
+        in_2  = in_1;
+        in_1  = in_0;
+        out_2 = out_1;
+        out_1 = out_0;
+    }
+
+    fixed->m_Error = error;
+    fixed->m_ProcessedSamples[0] = out_1;
+    fixed->m_ProcessedSamples[1] = out_2;
+    fixed->m_RawSamples[0] = in_1;
+    fixed->m_RawSamples[1] = in_2;
+}
+
+void ape_fixed_filter_q15(APE_FixedState* fixed, const int16_t* in_samples, int16_t* out_samples, uint32_t num_samples)
+{
+    filter_q15_strided(fixed, in_samples, out_samples, num_samples, 1);
+}
+
+bool ape_set_kernel(APE_Kernel kernel)
+{
+    ape_kernels_init();
+    if(kernel >= APE_KERNEL_COUNT || !kernel_supported(kernel))
+        return false;
+
+    apply_kernel(kernel);
+    return true;
+}
+
+APE_Kernel ape_get_kernel()
+{
+    ape_kernels_init();
+    return atomic_load_explicit(&_active_kernel, memory_order_acquire);
+}
+
+const char* ape_kernel_name(APE_Kernel kernel)
+{
+    if(kernel >= APE_KERNEL_COUNT)
+        return NULL;
+    return _kernel_names[kernel];
+}
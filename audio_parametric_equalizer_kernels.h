@@ -0,0 +1,78 @@
+#ifndef AUDIO_PARAMETRIC_EQUALIZER_KERNELS
+#define AUDIO_PARAMETRIC_EQUALIZER_KERNELS
+
+#include "audio_parametric_equalizer.h"
+
+// detect the cpu features and pick the kernels.  only does work the first time it is called, safe from any thread
+void ape_kernels_init();
+
+// filters a block with the coefficients in filter and leaves the end of the block in its history.  there is no
+// dispatch here: the recursion has to run in this order to stay bit-exact, so vectors only help across sections
+// (see APE_FilterLaneKernel)
+// NOTE: in_samples and out_samples may be the same buffer
+void ape_kernels_filter_scalar(APE_FilterState* filter, const APE_Sample* in_samples, APE_Sample* out_samples, uint32_t num_samples);
+
+// sections the float lane kernels filter side by side
+#define APE_FILTER_LANES 16
+
+// filters lane_count (up to APE_FILTER_LANES) sections side by side, each over its own buffers
+// NOTE: a lane's in and out buffers may be the same, but the lanes cant share buffers
+typedef void (*APE_FilterLaneKernel)(APE_FilterState* const* filters, uint32_t lane_count, const APE_Sample* const* in_samples, APE_Sample* const* out_samples, uint32_t num_samples);
+
+// the float lane kernel for the active APE_Kernel
+APE_FilterLaneKernel ape_kernels_filter_lanes();
+
+// the fixed point engines need this many sections packed together to fill a Q15 register
+#define APE_Q15_LANES 16
+
+// coefficients and history for the fixed point engines
+//      Q31 - coefficients are Q(30 - m_Shift), with m_Shift picked so their magnitudes sum under 2^32 and 5 products
+//            and the error fit an int64.  samples are Q31
+//      Q15 - coefficients are Q15 of the float coefficient / 2^m_Shift, the sum is doubled back up m_Shift times
+typedef struct _fixed_state
+{
+    int32_t m_B0;
+    int32_t m_B1;
+    int32_t m_B2;
+    int32_t m_A1;
+    int32_t m_A2;
+    int32_t m_Shift;
+    int32_t m_RawSamples[APE_SAMPLE_HISTORY_COUNT];
+    int32_t m_ProcessedSamples[APE_SAMPLE_HISTORY_COUNT];
+    int64_t m_Error; // what the last Q31 output dropped, fed into the next one
+} APE_FixedState;
+
+// filters lane_count (up to APE_Q15_LANES) sections side by side.  samples are interleaved, in_samples[sample * APE_Q15_LANES + lane]
+typedef void (*APE_Q15LaneKernel)(APE_FixedState* const* states, uint32_t lane_count, const int16_t* in_samples, int16_t* out_samples, uint32_t num_samples);
+
+// a peaking section's coefficients, normalized so a0 is 1
+typedef struct _section_coefficients
+{
+    double m_B0;
+    double m_B1;
+    double m_B2;
+    double m_A1;
+    double m_A2;
+} APE_SectionCoefficients;
+
+// the coefficients for a spectrum.  worked out in double in this file, which never fuses a multiply and add, so every
+// build gets the same ones from the same libm.  the float filter rounds them and the fixed point engines quantize them
+void ape_kernels_coefficients(const APE_FrequencySpectrum* frequncy_sample, APE_SectionCoefficients* coefficients);
+
+// quantize the coefficients for the engine.  the fixed point history is left alone
+void ape_fixed_quantize(APE_FixedState* fixed, const APE_SectionCoefficients* coefficients, APE_Engine engine);
+
+// true if the engine can run the state without overflowing, as ape_fixed_quantize and the filters would leave it.
+// for checking state that came from outside, like a snapshot
+bool ape_fixed_state_valid(const APE_FixedState* fixed, APE_Engine engine);
+
+// Q31 with a 64 bit accumulator and first order error feedback
+void ape_fixed_filter_q31(APE_FixedState* fixed, const int32_t* in_samples, int32_t* out_samples, uint32_t num_samples);
+
+// Q15 for a single section.  gives the same output as a lane in the lane kernel
+void ape_fixed_filter_q15(APE_FixedState* fixed, const int16_t* in_samples, int16_t* out_samples, uint32_t num_samples);
+
+// the Q15 lane kernel for the active APE_Kernel
+APE_Q15LaneKernel ape_kernels_filter_q15_lanes();
+
+#endif
@@ -0,0 +1,359 @@
+#include "audio_parametric_equalizer_multirate.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define MULTIRATE_HEADER_UINT32 0x4554524D // "MRTE"
+
+// half-band filters are 4 * K - 1 taps long.  every other tap is 0 apart from the center, so there are K unique
+// non-zero coefficients either side of the center
+#define HALFBAND_HALF_TAPS 12
+#define HALFBAND_TAPS (4 * HALFBAND_HALF_TAPS - 1)
+#define HALFBAND_CENTER (2 * HALFBAND_HALF_TAPS - 1)
+
+// a section is decimated when frequency + bandwidth is under this fraction of the decimated sample rate
+#define DECIMATED_BAND_LIMIT 0.1f
+
+// multiplies per sample for one biquad section at its own rate
+#define SECTION_COST 5.0f
+
+typedef struct _halfband_stage
+{
+    // delay lines are stored twice so the window is always contiguous
+    float m_DecimatorLine[HALFBAND_TAPS * 2];
+    uint32_t m_DecimatorPosition;
+    uint32_t m_Phase;
+    float m_InterpolatorLine[HALFBAND_HALF_TAPS * 4];
+    uint32_t m_InterpolatorPosition;
+    float m_HeldSample;
+
+    // the output of this stage's decimator, filtered in place by the stages below it
+    APE_Sample* m_Samples;
+} APE_HalfbandStage;
+
+typedef struct _multirate_descriptor
+{
+    uint32_t m_Check;
+    uint32_t m_StageCount;
+    uint32_t m_MaxBlockSize;
+    uint32_t m_Latency;
+    bool m_Bypass;              // decided at create time.  every section runs at the full rate with no latency
+    APE_Context m_Context;
+    float m_Taps[HALFBAND_HALF_TAPS];               // h[center + 1], h[center + 3], ...
+    float m_InterpolatorTaps[HALFBAND_HALF_TAPS];   // m_Taps with the gain of 2 to make up for the zero stuffing
+    APE_HalfbandStage m_Stages[APE_MULTIRATE_MAX_STAGES];
+
+    APE_Sample* m_Difference;   // the full rate output of the interpolators
+    APE_Sample* m_LowInput;     // the decimated input before the low sections
+    APE_Sample* m_DirectLine;   // delays the direct path by m_Latency
+    uint32_t m_DirectPosition;
+
+    APE_MultirateStats m_Stats;
+} APE_MultirateData;
+
+static bool is_valid_multirate(const APE_MultirateData* multirate_info)
+{
+    return multirate_info && multirate_info->m_Check == MULTIRATE_HEADER_UINT32;
+}
+
+// windowed sinc half-band low pass with the cutoff at a quarter of the rate
+static void build_halfband_taps(float* taps)
+{
+    double sum = 0.0;
+    double window_taps[HALFBAND_HALF_TAPS];
+    for(uint32_t tap_index = 0; tap_index < HALFBAND_HALF_TAPS; ++tap_index)
+    {
+        int32_t offset = 2 * tap_index + 1;
+        double sinc = sin(M_PI * offset / 2.0) / (M_PI * offset);
+        double window_position = (double)(HALFBAND_CENTER + offset) / (HALFBAND_TAPS - 1);
+        double blackman = 0.42 - 0.5 * cos(2.0 * M_PI * window_position) + 0.08 * cos(4.0 * M_PI * window_position);
+        window_taps[tap_index] = sinc * blackman;
+        sum += 2.0 * window_taps[tap_index];
+    }
+
+    // the center tap is 0.5, so scale the rest to make the gain at DC exactly 1
+    for(uint32_t tap_index = 0; tap_index < HALFBAND_HALF_TAPS; ++tap_index)
+    {
+        taps[tap_index] = window_taps[tap_index] * 0.5 / sum;
+    }
+}
+
+// returns how many samples were decimated into stage->m_Samples
+static uint32_t decimate(const APE_MultirateData* multirate_info, APE_HalfbandStage* stage, const APE_Sample* in_samples, uint32_t num_samples)
+{
+    uint32_t decimated_count = 0;
+    for(uint32_t sample_index = 0; sample_index < num_samples; ++sample_index)
+    {
+        stage->m_DecimatorPosition = stage->m_DecimatorPosition == 0 ? HALFBAND_TAPS - 1 : stage->m_DecimatorPosition - 1;
+        stage->m_DecimatorLine[stage->m_DecimatorPosition] = in_samples[sample_index];
+        stage->m_DecimatorLine[stage->m_DecimatorPosition + HALFBAND_TAPS] = in_samples[sample_index];
+
+        // only every other output is kept, so only work those out
+        if(stage->m_Phase ^= 1)
+            continue;
+
+        const float* window = &stage->m_DecimatorLine[stage->m_DecimatorPosition]; // window[n] = x[now - n]
+        float out_sample = 0.5f * window[HALFBAND_CENTER];
+        for(uint32_t tap_index = 0; tap_index < HALFBAND_HALF_TAPS; ++tap_index)
+        {
+            uint32_t offset = 2 * tap_index + 1;
+            out_sample += multirate_info->m_Taps[tap_index] * (window[HALFBAND_CENTER - offset] + window[HALFBAND_CENTER + offset]);
+        }
+        stage->m_Samples[decimated_count++] = out_sample;
+    }
+    return decimated_count;
+}
+
+// one output per input.  the inputs where decimate() kept a sample pick up the filtered sample from the stage below
+// and give both of its interpolated samples, the first now and the second on the next input
+static void interpolate(const APE_MultirateData* multirate_info, APE_HalfbandStage* stage, uint32_t start_phase, APE_Sample* out_samples, uint32_t num_samples)
+{
+    const uint32_t line_size = HALFBAND_HALF_TAPS * 2;
+    uint32_t phase = start_phase;
+    uint32_t decimated_index = 0;
+    for(uint32_t sample_index = 0; sample_index < num_samples; ++sample_index)
+    {
+        if(phase ^= 1)
+        {
+            out_samples[sample_index] = stage->m_HeldSample;
+            continue;
+        }
+
+        float in_sample = stage->m_Samples[decimated_index++];
+        stage->m_InterpolatorPosition = stage->m_InterpolatorPosition == 0 ? line_size - 1 : stage->m_InterpolatorPosition - 1;
+        stage->m_InterpolatorLine[stage->m_InterpolatorPosition] = in_sample;
+        stage->m_InterpolatorLine[stage->m_InterpolatorPosition + line_size] = in_sample;
+
+        // the even phase is the filter, the odd phase is just the center tap
+        const float* window = &stage->m_InterpolatorLine[stage->m_InterpolatorPosition];
+        float even_sample = 0.0f;
+        for(uint32_t tap_index = 0; tap_index < HALFBAND_HALF_TAPS; ++tap_index)
+        {
+            even_sample += multirate_info->m_InterpolatorTaps[tap_index] * (window[HALFBAND_HALF_TAPS - 1 - tap_index] + window[HALFBAND_HALF_TAPS + tap_index]);
+        }
+        out_samples[sample_index] = even_sample;
+        stage->m_HeldSample = window[HALFBAND_HALF_TAPS - 1];
+    }
+}
+
+static bool is_decimated_section(const APE_FrequencySpectrum* spectrum, uint32_t stage_count)
+{
+    float decimated_rate = spectrum->m_SampleRate / (float)(1 << stage_count);
+    return spectrum->m_Frequency + spectrum->m_Bandwidth < decimated_rate * DECIMATED_BAND_LIMIT;
+}
+
+// multiplies per input sample for a run with the given split
+static float multirate_cost(uint32_t stage_count, uint32_t decimated_sections, uint32_t full_rate_sections)
+{
+    // decimators and interpolators both only do work on every other sample at their rate
+    float cost = 0.0f;
+    for(uint32_t stage_index = 0; stage_index < stage_count; ++stage_index)
+    {
+        float stage_rate = 1.0f / (float)(1 << stage_index);
+        cost += stage_rate * 0.5f * (HALFBAND_HALF_TAPS + 1);
+        cost += stage_rate * 0.5f * HALFBAND_HALF_TAPS;
+    }
+    float decimated_rate = 1.0f / (float)(1 << stage_count);
+    cost += decimated_rate * (SECTION_COST * decimated_sections + 1.0f);
+    cost += 1.0f + SECTION_COST * full_rate_sections;
+    return cost;
+}
+
+APE_Multirate ape_multirate_create(uint32_t stages, uint32_t max_block_size, const APE_FrequencySpectrum* spectrums, uint32_t handle_count)
+{
+    return ape_multirate_create_in_context(NULL, stages, max_block_size, spectrums, handle_count);
+}
+
+APE_Multirate ape_multirate_create_in_context(APE_Context context, uint32_t stages, uint32_t max_block_size, const APE_FrequencySpectrum* spectrums, uint32_t handle_count)
+{
+    if(stages == 0 || stages > APE_MULTIRATE_MAX_STAGES)
+        return NULL;
+
+    APE_MultirateData* multirate_info = calloc(1, sizeof(APE_MultirateData));
+    if(multirate_info == NULL)
+        return NULL;
+
+    if(max_block_size == 0) // dont let stupid be stupid
+        max_block_size = 1;
+
+    multirate_info->m_Context = context;
+    multirate_info->m_StageCount = stages;
+    multirate_info->m_MaxBlockSize = max_block_size;
+    multirate_info->m_Check = MULTIRATE_HEADER_UINT32;
+
+    // the latency cant change once audio is flowing, so whether the half-band path pays for itself is decided once here
+    uint32_t decimated_sections = 0;
+    for(uint32_t handle_index = 0; handle_index < handle_count; ++handle_index)
+    {
+        if(is_decimated_section(&spectrums[handle_index], stages))
+            decimated_sections++;
+    }
+    if(multirate_cost(stages, decimated_sections, handle_count - decimated_sections) >= SECTION_COST * handle_count)
+    {
+        multirate_info->m_Bypass = true;
+        multirate_info->m_StageCount = 0;
+        return (APE_Multirate)multirate_info;
+    }
+
+    // each stage delays by its center tap going down and again coming back up, counted at its own rate
+    multirate_info->m_Latency = 2 * HALFBAND_CENTER * ((1 << stages) - 1);
+    build_halfband_taps(multirate_info->m_Taps);
+    for(uint32_t tap_index = 0; tap_index < HALFBAND_HALF_TAPS; ++tap_index)
+    {
+        multirate_info->m_InterpolatorTaps[tap_index] = 2.0f * multirate_info->m_Taps[tap_index];
+    }
+
+    bool success = true;
+    for(uint32_t stage_index = 0; success && stage_index < stages; ++stage_index)
+    {
+        // a block can give one more than half when the phase carries over
+        uint32_t stage_size = (max_block_size >> (stage_index + 1)) + 1;
+        multirate_info->m_Stages[stage_index].m_Samples = malloc(sizeof(APE_Sample) * stage_size);
+        success = multirate_info->m_Stages[stage_index].m_Samples != NULL;
+    }
+    multirate_info->m_Difference = malloc(sizeof(APE_Sample) * max_block_size);
+    multirate_info->m_LowInput = malloc(sizeof(APE_Sample) * ((max_block_size >> stages) + 1));
+    multirate_info->m_DirectLine = calloc(multirate_info->m_Latency, sizeof(APE_Sample));
+    success = success && multirate_info->m_Difference != NULL && multirate_info->m_LowInput != NULL && multirate_info->m_DirectLine != NULL;
+
+    if(!success)
+    {
+        ape_multirate_destroy(multirate_info);
+        return NULL;
+    }
+    return (APE_Multirate)multirate_info;
+}
+
+void ape_multirate_destroy(APE_Multirate multirate)
+{
+    APE_MultirateData* multirate_info = (APE_MultirateData*)multirate;
+    if(!is_valid_multirate(multirate_info))
+        return;
+
+    for(uint32_t stage_index = 0; stage_index < multirate_info->m_StageCount; ++stage_index)
+    {
+        free(multirate_info->m_Stages[stage_index].m_Samples);
+    }
+    free(multirate_info->m_Difference);
+    free(multirate_info->m_LowInput);
+    free(multirate_info->m_DirectLine);
+    multirate_info->m_Check = 0;
+    free(multirate_info);
+}
+
+void ape_multirate_run(APE_Multirate multirate, const APE_EqualizerHandle* handles, const APE_FrequencySpectrum* spectrums, uint32_t handle_count,
+                       const APE_Sample* in_samples, APE_Sample* out_samples, uint32_t num_samples)
+{
+    APE_MultirateData* multirate_info = (APE_MultirateData*)multirate;
+    assert(is_valid_multirate(multirate_info) && "Invalid multirate.");
+    assert(num_samples <= multirate_info->m_MaxBlockSize && "Block is bigger than the multirate was created for.");
+
+    if(multirate_info->m_Bypass)
+    {
+        if(in_samples != out_samples)
+            memmove(out_samples, in_samples, sizeof(APE_Sample) * num_samples);
+        for(uint32_t handle_index = 0; handle_index < handle_count; ++handle_index)
+        {
+            ape_context_run_filter(multirate_info->m_Context, handles[handle_index], &spectrums[handle_index], out_samples, out_samples, num_samples);
+        }
+        multirate_info->m_Stats.m_DecimatedSections = 0;
+        multirate_info->m_Stats.m_FullRateSections = handle_count;
+        multirate_info->m_Stats.m_FullRateCost = SECTION_COST * handle_count;
+        multirate_info->m_Stats.m_MultirateCost = multirate_info->m_Stats.m_FullRateCost;
+        return;
+    }
+
+    uint32_t stage_count = multirate_info->m_StageCount;
+    uint32_t start_phases[APE_MULTIRATE_MAX_STAGES];
+    uint32_t stage_sizes[APE_MULTIRATE_MAX_STAGES + 1];
+
+    // down
+    const APE_Sample* stage_input = in_samples;
+    stage_sizes[0] = num_samples;
+    for(uint32_t stage_index = 0; stage_index < stage_count; ++stage_index)
+    {
+        APE_HalfbandStage* stage = &multirate_info->m_Stages[stage_index];
+        start_phases[stage_index] = stage->m_Phase;
+        stage_sizes[stage_index + 1] = decimate(multirate_info, stage, stage_input, stage_sizes[stage_index]);
+        stage_input = stage->m_Samples;
+    }
+
+    // run the low sections in place and leave only the difference they make to their reference gain
+    APE_Sample* low_samples = multirate_info->m_Stages[stage_count - 1].m_Samples;
+    uint32_t low_count = stage_sizes[stage_count];
+    float reference_gain = 1.0f;
+    memcpy(multirate_info->m_LowInput, low_samples, sizeof(APE_Sample) * low_count);
+    multirate_info->m_Stats.m_DecimatedSections = 0;
+    multirate_info->m_Stats.m_FullRateSections = 0;
+    for(uint32_t handle_index = 0; handle_index < handle_count; ++handle_index)
+    {
+        if(!is_decimated_section(&spectrums[handle_index], stage_count))
+            continue;
+
+        APE_FrequencySpectrum decimated_spectrum = spectrums[handle_index];
+        decimated_spectrum.m_SampleRate /= (float)(1 << stage_count);
+        ape_context_run_filter(multirate_info->m_Context, handles[handle_index], &decimated_spectrum, low_samples, low_samples, low_count);
+        reference_gain *= powf(10.0f, spectrums[handle_index].m_ReferenceGain / 20.0f);
+        multirate_info->m_Stats.m_DecimatedSections++;
+    }
+    for(uint32_t sample_index = 0; sample_index < low_count; ++sample_index)
+    {
+        low_samples[sample_index] -= reference_gain * multirate_info->m_LowInput[sample_index];
+    }
+
+    // up
+    for(uint32_t stage_index = stage_count; stage_index > 0; --stage_index)
+    {
+        APE_HalfbandStage* stage = &multirate_info->m_Stages[stage_index - 1];
+        APE_Sample* stage_output = stage_index > 1 ? multirate_info->m_Stages[stage_index - 2].m_Samples : multirate_info->m_Difference;
+        interpolate(multirate_info, stage, start_phases[stage_index - 1], stage_output, stage_sizes[stage_index - 1]);
+    }
+
+    // recombine with the direct path delayed to match.  reads in_samples before writing in case they are the same buffer
+    for(uint32_t sample_index = 0; sample_index < num_samples; ++sample_index)
+    {
+        float direct_sample = multirate_info->m_DirectLine[multirate_info->m_DirectPosition];
+        multirate_info->m_DirectLine[multirate_info->m_DirectPosition] = in_samples[sample_index];
+        if(++multirate_info->m_DirectPosition == multirate_info->m_Latency)
+            multirate_info->m_DirectPosition = 0;
+
+        out_samples[sample_index] = reference_gain * direct_sample + multirate_info->m_Difference[sample_index];
+    }
+
+    // everything else at the full rate
+    for(uint32_t handle_index = 0; handle_index < handle_count; ++handle_index)
+    {
+        if(is_decimated_section(&spectrums[handle_index], stage_count))
+            continue;
+
+        ape_context_run_filter(multirate_info->m_Context, handles[handle_index], &spectrums[handle_index], out_samples, out_samples, num_samples);
+        multirate_info->m_Stats.m_FullRateSections++;
+    }
+
+    multirate_info->m_Stats.m_MultirateCost = multirate_cost(stage_count, multirate_info->m_Stats.m_DecimatedSections, multirate_info->m_Stats.m_FullRateSections);
+    multirate_info->m_Stats.m_FullRateCost = SECTION_COST * handle_count;
+}
+
+uint32_t ape_multirate_latency(APE_Multirate multirate)
+{
+    APE_MultirateData* multirate_info = (APE_MultirateData*)multirate;
+    if(!is_valid_multirate(multirate_info))
+        return 0;
+    return multirate_info->m_Latency;
+}
+
+void ape_multirate_stats(APE_Multirate multirate, APE_MultirateStats* stats)
+{
+    APE_MultirateData* multirate_info = (APE_MultirateData*)multirate;
+    if(!is_valid_multirate(multirate_info))
+    {
+        memset(stats, 0, sizeof(APE_MultirateStats));
+        return;
+    }
+    *stats = multirate_info->m_Stats;
+}
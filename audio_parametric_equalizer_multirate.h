@@ -0,0 +1,51 @@
+#ifndef AUDIO_PARAMETRIC_EQUALIZER_MULTIRATE
+#define AUDIO_PARAMETRIC_EQUALIZER_MULTIRATE
+
+#include "audio_parametric_equalizer.h"
+
+// runs a chain of handles where the low frequency sections are filtered at a decimated rate.
+// only the difference a low section makes to its reference gain goes down the half-band decimators and back up the
+// interpolators; everything else takes a delayed direct path so the two line up.  the rest of the sections run at the
+// full rate.  this keeps the low poles away from the unit circle and runs those sections on a fraction of the samples
+// NOTE: the half-band filters cost about as much as 5 sections, so it only saves cpu with more low sections than that.
+//       ape_multirate_stats gives the numbers.  since the latency cant change while audio is flowing, the call is made
+//       once at create time: if the starting spectrums dont have enough low sections to pay for the half-band filters
+//       the multirate is a bypass for its whole life, running every section at the full rate with no latency
+typedef void* APE_Multirate;
+
+#define APE_MULTIRATE_MAX_STAGES 4
+
+typedef struct _multirate_stats
+{
+    uint32_t m_DecimatedSections;   // sections that ran at the decimated rate on the last run
+    uint32_t m_FullRateSections;    // sections that ran at the full rate on the last run
+    float m_FullRateCost;           // multiplies per input sample if every section ran at the full rate
+    float m_MultirateCost;          // multiplies per input sample for the last run, including the half-band filters
+} APE_MultirateStats;
+
+// gives you a multirate chain
+// in:
+//      stages - half-band stages.  low sections run at the sample rate / 2^stages.  1 to APE_MULTIRATE_MAX_STAGES
+//      max_block_size - the most samples a single ape_multirate_run will process
+//      spectrums, handle_count - the sections the chain starts with.  only used to decide whether to bypass
+APE_Multirate ape_multirate_create(uint32_t stages, uint32_t max_block_size, const APE_FrequencySpectrum* spectrums, uint32_t handle_count);
+
+// same as ape_multirate_create, for handles from the given context
+APE_Multirate ape_multirate_create_in_context(APE_Context context, uint32_t stages, uint32_t max_block_size, const APE_FrequencySpectrum* spectrums, uint32_t handle_count);
+
+void ape_multirate_destroy(APE_Multirate multirate);
+
+// run handles[0] -> handles[handle_count - 1] in series over in_samples.  a section is decimated when its frequency
+// plus bandwidth is under a tenth of the decimated sample rate
+// NOTE: keep using the same handles with the same multirate.  a section that moves between rates glitches since its
+//       history is from the other rate
+void ape_multirate_run(APE_Multirate multirate, const APE_EqualizerHandle* handles, const APE_FrequencySpectrum* spectrums, uint32_t handle_count,
+                       const APE_Sample* in_samples, APE_Sample* out_samples, uint32_t num_samples);
+
+// samples of delay the chain adds.  fixed for the life of the multirate, 0 when it is a bypass
+uint32_t ape_multirate_latency(APE_Multirate multirate);
+
+// how the last run split the sections and what it saved
+void ape_multirate_stats(APE_Multirate multirate, APE_MultirateStats* stats);
+
+#endif
@@ -0,0 +1,356 @@
+// Real-time deadline simulation for the equalizer.
+//
+// Drives a set of voices through ape_run_filter from a periodic callback and reports how long each block took
+// against the audio deadline.  background threads can burn cpu and thrash memory to see how that holds up under load.
+//
+// build from the repo root:
+//      gcc -std=gnu11 -O2 -I. harness/deadline_harness.c audio_parametric_equalizer*.c array.c queue.c -lm -lpthread -o deadline_harness
+//
+// run with --help for the options
+
+#define _GNU_SOURCE
+#include "audio_parametric_equalizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define NANOSECONDS_PER_SECOND 1000000000ull
+#define HISTOGRAM_BUCKET_COUNT 32 // power of 2 microsecond buckets
+
+typedef struct _harness_options
+{
+    uint32_t m_SampleRate;
+    uint32_t m_BlockSize;
+    uint32_t m_PeriodMicroseconds; // 0 = derive from the block size and sample rate
+    uint32_t m_VoiceCount;
+    uint32_t m_BlockCount;
+    float m_ChangesPerSecond;      // spectrum changes per voice per second
+    uint32_t m_CpuNoiseThreads;
+    uint32_t m_MemoryNoiseThreads;
+    uint32_t m_MemoryNoiseMegabytes; // per memory noise thread
+} HarnessOptions;
+
+typedef struct _noise_thread
+{
+    pthread_t m_Thread;
+    uint32_t m_Megabytes;
+    atomic_bool* m_Running;
+} NoiseThread;
+
+static uint64_t now_nanoseconds()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * NANOSECONDS_PER_SECOND + time.tv_nsec;
+}
+
+static void sleep_until(uint64_t nanoseconds)
+{
+    struct timespec time;
+    time.tv_sec = nanoseconds / NANOSECONDS_PER_SECOND;
+    time.tv_nsec = nanoseconds % NANOSECONDS_PER_SECOND;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL) != 0)
+    {
+    }
+}
+
+static void* cpu_noise(void* user_data)
+{
+    NoiseThread* noise = user_data;
+    volatile double sink = 1.0;
+    while(atomic_load_explicit(noise->m_Running, memory_order_relaxed))
+    {
+        for(uint32_t loop_index = 0; loop_index < 10000; ++loop_index)
+            sink = sqrt(sink + loop_index);
+    }
+    return NULL;
+}
+
+static void* memory_noise(void* user_data)
+{
+    NoiseThread* noise = user_data;
+    size_t size = (size_t)noise->m_Megabytes * 1024 * 1024;
+    uint8_t* buffer = malloc(size);
+    if(buffer == NULL)
+        return NULL;
+
+    // stream through a buffer bigger than the cache so the filter state keeps getting evicted
+    uint8_t value = 0;
+    while(atomic_load_explicit(noise->m_Running, memory_order_relaxed))
+    {
+        memset(buffer, value++, size);
+    }
+    free(buffer);
+    return NULL;
+}
+
+static int compare_latency(const void* left, const void* right)
+{
+    uint64_t left_value = *(const uint64_t*)left;
+    uint64_t right_value = *(const uint64_t*)right;
+    return (left_value > right_value) - (left_value < right_value);
+}
+
+static uint64_t percentile(const uint64_t* sorted, uint32_t count, double fraction)
+{
+    uint32_t index = (uint32_t)ceil(fraction * count);
+    if(index > 0)
+        index--;
+    if(index >= count)
+        index = count - 1;
+    return sorted[index];
+}
+
+static void print_usage(const char* program)
+{
+    printf("usage: %s [options]\n"
+           "    --sample-rate HZ        sample rate of the voices (48000)\n"
+           "    --block SAMPLES         samples per callback (128)\n"
+           "    --period US             callback period in microseconds (block / sample rate)\n"
+           "    --voices COUNT          handles run each callback (256)\n"
+           "    --blocks COUNT          callbacks to simulate (10000)\n"
+           "    --change-rate PER_SEC   spectrum changes per voice per second (1)\n"
+           "    --cpu-noise THREADS     background threads burning cpu (0)\n"
+           "    --mem-noise THREADS     background threads streaming memory (0)\n"
+           "    --mem-noise-mb MB       buffer per memory noise thread (64)\n",
+           program);
+}
+
+static bool parse_options(int argc, char** argv, HarnessOptions* options)
+{
+    options->m_SampleRate = 48000;
+    options->m_BlockSize = 128;
+    options->m_PeriodMicroseconds = 0;
+    options->m_VoiceCount = 256;
+    options->m_BlockCount = 10000;
+    options->m_ChangesPerSecond = 1.0f;
+    options->m_CpuNoiseThreads = 0;
+    options->m_MemoryNoiseThreads = 0;
+    options->m_MemoryNoiseMegabytes = 64;
+
+    for(int arg_index = 1; arg_index < argc; ++arg_index)
+    {
+        const char* name = argv[arg_index];
+        if(strcmp(name, "--help") == 0 || arg_index + 1 >= argc)
+            return false;
+
+        const char* value = argv[++arg_index];
+        if(strcmp(name, "--sample-rate") == 0)
+            options->m_SampleRate = strtoul(value, NULL, 10);
+        else if(strcmp(name, "--block") == 0)
+            options->m_BlockSize = strtoul(value, NULL, 10);
+        else if(strcmp(name, "--period") == 0)
+            options->m_PeriodMicroseconds = strtoul(value, NULL, 10);
+        else if(strcmp(name, "--voices") == 0)
+            options->m_VoiceCount = strtoul(value, NULL, 10);
+        else if(strcmp(name, "--blocks") == 0)
+            options->m_BlockCount = strtoul(value, NULL, 10);
+        else if(strcmp(name, "--change-rate") == 0)
+            options->m_ChangesPerSecond = strtof(value, NULL);
+        else if(strcmp(name, "--cpu-noise") == 0)
+            options->m_CpuNoiseThreads = strtoul(value, NULL, 10);
+        else if(strcmp(name, "--mem-noise") == 0)
+            options->m_MemoryNoiseThreads = strtoul(value, NULL, 10);
+        else if(strcmp(name, "--mem-noise-mb") == 0)
+            options->m_MemoryNoiseMegabytes = strtoul(value, NULL, 10);
+        else
+            return false;
+    }
+
+    if(options->m_SampleRate == 0 || options->m_BlockSize == 0 || options->m_BlockCount == 0)
+        return false;
+    if(options->m_PeriodMicroseconds == 0)
+        options->m_PeriodMicroseconds = (uint32_t)((uint64_t)options->m_BlockSize * 1000000 / options->m_SampleRate);
+    return true;
+}
+
+static void random_spectrum(APE_FrequencySpectrum* spectrum, float sample_rate)
+{
+    spectrum->m_SampleRate = sample_rate;
+    spectrum->m_Frequency = 40.0f + (sample_rate * 0.4f - 40.0f) * ((float)rand() / RAND_MAX);
+    spectrum->m_Bandwidth = spectrum->m_Frequency * 0.5f;
+    spectrum->m_BandwidthGain = 3.0f;
+    spectrum->m_ReferenceGain = 0.0f;
+    spectrum->m_GainAdjustment = -12.0f + 24.0f * ((float)rand() / RAND_MAX);
+}
+
+int main(int argc, char** argv)
+{
+    HarnessOptions options;
+    if(!parse_options(argc, argv, &options))
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    APE_EqualizerHandle* handles = malloc(sizeof(APE_EqualizerHandle) * (options.m_VoiceCount + 1));
+    APE_FrequencySpectrum* spectrums = malloc(sizeof(APE_FrequencySpectrum) * (options.m_VoiceCount + 1));
+    // every voice gets its own buffers so the working set grows with the voice count like it would in a real mixer
+    size_t voice_samples = (size_t)options.m_VoiceCount * options.m_BlockSize;
+    APE_Sample* in_samples = malloc(sizeof(APE_Sample) * (voice_samples + 1));
+    APE_Sample* out_samples = malloc(sizeof(APE_Sample) * (voice_samples + 1));
+    uint64_t* latencies = malloc(sizeof(uint64_t) * options.m_BlockCount);
+    uint64_t* jitters = malloc(sizeof(uint64_t) * options.m_BlockCount);
+    uint32_t noise_count = options.m_CpuNoiseThreads + options.m_MemoryNoiseThreads;
+    NoiseThread* noise_threads = calloc(noise_count + 1, sizeof(NoiseThread));
+    uint32_t* change_starts = malloc(sizeof(uint32_t) * (options.m_BlockCount + 1));
+    if(!handles || !spectrums || !in_samples || !out_samples || !latencies || !jitters || !noise_threads || !change_starts)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    srand(1);
+    for(uint32_t voice_index = 0; voice_index < options.m_VoiceCount; ++voice_index)
+    {
+        handles[voice_index] = ape_obtain();
+        random_spectrum(&spectrums[voice_index], options.m_SampleRate);
+    }
+    for(size_t sample_index = 0; sample_index < voice_samples; ++sample_index)
+    {
+        in_samples[sample_index] = (float)rand() / RAND_MAX - 0.5f;
+    }
+
+    // the chance any one voice changes its spectrum in a block
+    uint64_t period = (uint64_t)options.m_PeriodMicroseconds * 1000;
+    double change_chance = options.m_ChangesPerSecond * ((double)period / NANOSECONDS_PER_SECOND);
+    uint32_t change_threshold = change_chance >= 1.0 ? RAND_MAX : (uint32_t)(change_chance * RAND_MAX);
+
+    // roll the spectrum changes up front so rand() and the random spectrums stay out of the timed callbacks.
+    // block n applies changes [change_starts[n], change_starts[n + 1])
+    uint32_t change_count = 0;
+    uint32_t change_capacity = 0;
+    uint32_t* change_voices = NULL;
+    APE_FrequencySpectrum* change_spectrums = NULL;
+    for(uint32_t block_index = 0; block_index < options.m_BlockCount; ++block_index)
+    {
+        change_starts[block_index] = change_count;
+        for(uint32_t voice_index = 0; voice_index < options.m_VoiceCount; ++voice_index)
+        {
+            if((uint32_t)rand() >= change_threshold)
+                continue;
+
+            if(change_count == change_capacity)
+            {
+                change_capacity = change_capacity == 0 ? 1024 : change_capacity * 2;
+                change_voices = realloc(change_voices, sizeof(uint32_t) * change_capacity);
+                change_spectrums = realloc(change_spectrums, sizeof(APE_FrequencySpectrum) * change_capacity);
+                if(!change_voices || !change_spectrums)
+                {
+                    fprintf(stderr, "out of memory\n");
+                    return 1;
+                }
+            }
+            change_voices[change_count] = voice_index;
+            random_spectrum(&change_spectrums[change_count], options.m_SampleRate);
+            change_count++;
+        }
+    }
+    change_starts[options.m_BlockCount] = change_count;
+
+    atomic_bool running = true;
+    for(uint32_t noise_index = 0; noise_index < noise_count; ++noise_index)
+    {
+        NoiseThread* noise = &noise_threads[noise_index];
+        noise->m_Running = &running;
+        noise->m_Megabytes = options.m_MemoryNoiseMegabytes;
+        pthread_create(&noise->m_Thread, NULL, noise_index < options.m_CpuNoiseThreads ? cpu_noise : memory_noise, noise);
+    }
+
+    uint32_t histogram[HISTOGRAM_BUCKET_COUNT] = { 0 };
+    uint32_t deadline_misses = 0;
+    uint32_t dropped_callbacks = 0; // periods that went by while a callback was overrunning
+    uint64_t block_start = now_nanoseconds() + period;
+    for(uint32_t block_index = 0; block_index < options.m_BlockCount; ++block_index, block_start += period)
+    {
+        sleep_until(block_start);
+        uint64_t wake_time = now_nanoseconds();
+
+        for(uint32_t change_index = change_starts[block_index]; change_index < change_starts[block_index + 1]; ++change_index)
+        {
+            spectrums[change_voices[change_index]] = change_spectrums[change_index];
+        }
+        for(uint32_t voice_index = 0; voice_index < options.m_VoiceCount; ++voice_index)
+        {
+            size_t voice_offset = (size_t)voice_index * options.m_BlockSize;
+            ape_run_filter(handles[voice_index], &spectrums[voice_index], &in_samples[voice_offset], &out_samples[voice_offset], options.m_BlockSize);
+        }
+
+        // latency is measured from when the callback should have fired so wake-up jitter counts against us
+        uint64_t end_time = now_nanoseconds();
+        uint64_t latency = end_time - block_start;
+        latencies[block_index] = latency;
+        jitters[block_index] = wake_time - block_start;
+        if(latency > period)
+        {
+            deadline_misses++;
+
+            // dont let one overrun cascade into every block after it, but every callback it swallowed missed its deadline too
+            while(block_start + period < end_time)
+            {
+                block_start += period;
+                dropped_callbacks++;
+            }
+        }
+
+        uint32_t bucket = 0;
+        for(uint64_t microseconds = latency / 1000; microseconds > 0 && bucket + 1 < HISTOGRAM_BUCKET_COUNT; microseconds >>= 1)
+            bucket++;
+        histogram[bucket]++;
+    }
+
+    atomic_store(&running, false);
+    for(uint32_t noise_index = 0; noise_index < noise_count; ++noise_index)
+    {
+        pthread_join(noise_threads[noise_index].m_Thread, NULL);
+    }
+
+    qsort(latencies, options.m_BlockCount, sizeof(uint64_t), compare_latency);
+    qsort(jitters, options.m_BlockCount, sizeof(uint64_t), compare_latency);
+
+    printf("sample rate %u, block %u, period %uus, voices %u, blocks %u, changes/s %.2f, cpu noise %u, mem noise %u x %uMB\n",
+           options.m_SampleRate, options.m_BlockSize, options.m_PeriodMicroseconds, options.m_VoiceCount, options.m_BlockCount,
+           options.m_ChangesPerSecond, options.m_CpuNoiseThreads, options.m_MemoryNoiseThreads, options.m_MemoryNoiseMegabytes);
+    printf("latency (us): p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           percentile(latencies, options.m_BlockCount, 0.5) / 1000.0,
+           percentile(latencies, options.m_BlockCount, 0.99) / 1000.0,
+           percentile(latencies, options.m_BlockCount, 0.999) / 1000.0,
+           latencies[options.m_BlockCount - 1] / 1000.0);
+    printf("wake jitter (us): p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           percentile(jitters, options.m_BlockCount, 0.5) / 1000.0,
+           percentile(jitters, options.m_BlockCount, 0.99) / 1000.0,
+           percentile(jitters, options.m_BlockCount, 0.999) / 1000.0,
+           jitters[options.m_BlockCount - 1] / 1000.0);
+    uint64_t callback_count = (uint64_t)options.m_BlockCount + dropped_callbacks;
+    printf("deadline misses: %llu of %llu callbacks (%.3f%%): %u overran, %u dropped while overrunning\n",
+           (unsigned long long)(deadline_misses + dropped_callbacks), (unsigned long long)callback_count,
+           100.0 * (deadline_misses + dropped_callbacks) / callback_count, deadline_misses, dropped_callbacks);
+    printf("latency histogram:\n");
+    for(uint32_t bucket = 0; bucket < HISTOGRAM_BUCKET_COUNT; ++bucket)
+    {
+        if(histogram[bucket] == 0)
+            continue;
+        uint64_t low = bucket == 0 ? 0 : 1ull << (bucket - 1);
+        printf("    %8llu - %8lluus: %u\n", (unsigned long long)low, (unsigned long long)(1ull << bucket), histogram[bucket]);
+    }
+
+    for(uint32_t voice_index = 0; voice_index < options.m_VoiceCount; ++voice_index)
+    {
+        ape_return(handles[voice_index]);
+    }
+    free(handles);
+    free(spectrums);
+    free(in_samples);
+    free(out_samples);
+    free(latencies);
+    free(jitters);
+    free(noise_threads);
+    free(change_starts);
+    free(change_voices);
+    free(change_spectrums);
+    return deadline_misses + dropped_callbacks == 0 ? 0 : 2;
+}
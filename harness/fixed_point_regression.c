@@ -0,0 +1,176 @@
+// Regression check for the fixed point engines.
+//
+// Runs a grid of peaking sections through the Q31 and Q15 engines and hashes the output.  the hashes have to match on
+// every machine and every build, so a change here means the fixed point output changed.  the Q15 lane kernels are
+// checked against the single section path for every kernel the cpu can run.
+//
+// build and run from the repo root (try it with -march=native and -O0 too, the hashes should not move):
+//      gcc -std=gnu11 -O2 -I. harness/fixed_point_regression.c audio_parametric_equalizer*.c array.c queue.c -lm -lpthread -o fixed_point_regression
+//      ./fixed_point_regression
+//
+// exits with 0 when every hash matches
+// NOTE: the coefficients come from libm's pow, tan, and cos, so a different libm can change the hashes
+
+#include "audio_parametric_equalizer.h"
+#include <stdio.h>
+
+#define REGRESSION_SAMPLE_COUNT 1024
+#define REGRESSION_BLOCK_SIZE 100 // not a power of 2, so blocks dont line up with the engines' chunks
+#define REGRESSION_SECTION_COUNT (4 * 5 * 4)
+
+// update these only when the fixed point output is meant to change
+#define EXPECTED_Q31_HASH 0xeb131ee64fd704aaull
+#define EXPECTED_Q15_HASH 0xaf2266d9fe28e6e7ull
+
+static const float _sample_rates[] = { 44100.0f, 48000.0f, 96000.0f, 192000.0f };
+static const float _frequencies[] = { 60.0f, 200.0f, 1000.0f, 4000.0f, 12000.0f };
+static const float _gains[] = { -12.0f, -3.0f, 6.0f, 12.0f };
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+    // FNV-1a
+    const uint8_t* bytes = data;
+    for(size_t byte_index = 0; byte_index < size; ++byte_index)
+    {
+        hash ^= bytes[byte_index];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static void build_spectrums(APE_FrequencySpectrum* spectrums)
+{
+    uint32_t section_index = 0;
+    for(uint32_t rate_index = 0; rate_index < sizeof(_sample_rates) / sizeof(float); ++rate_index)
+    {
+        for(uint32_t frequency_index = 0; frequency_index < sizeof(_frequencies) / sizeof(float); ++frequency_index)
+        {
+            for(uint32_t gain_index = 0; gain_index < sizeof(_gains) / sizeof(float); ++gain_index)
+            {
+                APE_FrequencySpectrum* spectrum = &spectrums[section_index++];
+                spectrum->m_SampleRate = _sample_rates[rate_index];
+                spectrum->m_Frequency = _frequencies[frequency_index];
+                spectrum->m_Bandwidth = _frequencies[frequency_index] / 2.0f;
+                spectrum->m_BandwidthGain = _gains[gain_index] / 2.0f;
+                spectrum->m_ReferenceGain = 0.0f;
+                spectrum->m_GainAdjustment = _gains[gain_index];
+            }
+        }
+    }
+}
+
+// white noise at half scale from a fixed seed
+static void build_input(int32_t* samples)
+{
+    uint32_t state = 0x12345678u;
+    for(uint32_t sample_index = 0; sample_index < REGRESSION_SAMPLE_COUNT; ++sample_index)
+    {
+        state = state * 1664525u + 1013904223u;
+        samples[sample_index] = (int32_t)state >> 1;
+    }
+}
+
+static uint64_t run_q31(const APE_FrequencySpectrum* spectrums, const int32_t* input)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    int32_t output[REGRESSION_SAMPLE_COUNT];
+    for(uint32_t section_index = 0; section_index < REGRESSION_SECTION_COUNT; ++section_index)
+    {
+        APE_EqualizerHandle handle = ape_obtain();
+        ape_set_engine(handle, APE_ENGINE_Q31);
+        for(uint32_t block_start = 0; block_start < REGRESSION_SAMPLE_COUNT; block_start += REGRESSION_BLOCK_SIZE)
+        {
+            uint32_t block_size = REGRESSION_SAMPLE_COUNT - block_start < REGRESSION_BLOCK_SIZE ? REGRESSION_SAMPLE_COUNT - block_start : REGRESSION_BLOCK_SIZE;
+            ape_run_filter_q31(handle, &spectrums[section_index], &input[block_start], &output[block_start], block_size);
+        }
+        hash = hash_bytes(hash, output, sizeof(output));
+        ape_return(handle);
+    }
+    return hash;
+}
+
+static uint64_t run_q15(const APE_FrequencySpectrum* spectrums, const int16_t* input)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    int16_t output[REGRESSION_SAMPLE_COUNT];
+    for(uint32_t section_index = 0; section_index < REGRESSION_SECTION_COUNT; ++section_index)
+    {
+        APE_EqualizerHandle handle = ape_obtain();
+        ape_set_engine(handle, APE_ENGINE_Q15);
+        for(uint32_t block_start = 0; block_start < REGRESSION_SAMPLE_COUNT; block_start += REGRESSION_BLOCK_SIZE)
+        {
+            uint32_t block_size = REGRESSION_SAMPLE_COUNT - block_start < REGRESSION_BLOCK_SIZE ? REGRESSION_SAMPLE_COUNT - block_start : REGRESSION_BLOCK_SIZE;
+            ape_run_filter_q15(handle, &spectrums[section_index], &input[block_start], &output[block_start], block_size);
+        }
+        hash = hash_bytes(hash, output, sizeof(output));
+        ape_return(handle);
+    }
+    return hash;
+}
+
+// the same sections through ape_run_filter_q15_lanes.  hashed in the same order, so it has to match run_q15
+static uint64_t run_q15_lanes(const APE_FrequencySpectrum* spectrums, const int16_t* input)
+{
+    static int16_t outputs[REGRESSION_SECTION_COUNT][REGRESSION_SAMPLE_COUNT];
+    APE_EqualizerHandle handles[REGRESSION_SECTION_COUNT];
+    const int16_t* in_pointers[REGRESSION_SECTION_COUNT];
+    int16_t* out_pointers[REGRESSION_SECTION_COUNT];
+    for(uint32_t section_index = 0; section_index < REGRESSION_SECTION_COUNT; ++section_index)
+    {
+        handles[section_index] = ape_obtain();
+        ape_set_engine(handles[section_index], APE_ENGINE_Q15);
+    }
+
+    for(uint32_t block_start = 0; block_start < REGRESSION_SAMPLE_COUNT; block_start += REGRESSION_BLOCK_SIZE)
+    {
+        uint32_t block_size = REGRESSION_SAMPLE_COUNT - block_start < REGRESSION_BLOCK_SIZE ? REGRESSION_SAMPLE_COUNT - block_start : REGRESSION_BLOCK_SIZE;
+        for(uint32_t section_index = 0; section_index < REGRESSION_SECTION_COUNT; ++section_index)
+        {
+            in_pointers[section_index] = &input[block_start];
+            out_pointers[section_index] = &outputs[section_index][block_start];
+        }
+        ape_run_filter_q15_lanes(handles, spectrums, REGRESSION_SECTION_COUNT, in_pointers, out_pointers, block_size);
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for(uint32_t section_index = 0; section_index < REGRESSION_SECTION_COUNT; ++section_index)
+    {
+        hash = hash_bytes(hash, outputs[section_index], sizeof(outputs[section_index]));
+        ape_return(handles[section_index]);
+    }
+    return hash;
+}
+
+static bool check_hash(const char* name, uint64_t hash, uint64_t expected)
+{
+    bool matched = hash == expected;
+    printf("%-16s 0x%016llx %s\n", name, (unsigned long long)hash, matched ? "ok" : "MISMATCH");
+    return matched;
+}
+
+int main()
+{
+    APE_FrequencySpectrum spectrums[REGRESSION_SECTION_COUNT];
+    int32_t input_q31[REGRESSION_SAMPLE_COUNT];
+    int16_t input_q15[REGRESSION_SAMPLE_COUNT];
+    build_spectrums(spectrums);
+    build_input(input_q31);
+    for(uint32_t sample_index = 0; sample_index < REGRESSION_SAMPLE_COUNT; ++sample_index)
+    {
+        input_q15[sample_index] = (int16_t)(input_q31[sample_index] >> 16);
+    }
+
+    bool success = check_hash("q31", run_q31(spectrums, input_q31), EXPECTED_Q31_HASH);
+    success = check_hash("q15", run_q15(spectrums, input_q15), EXPECTED_Q15_HASH) && success;
+    for(uint32_t kernel = 0; kernel < APE_KERNEL_COUNT; ++kernel)
+    {
+        if(!ape_set_kernel((APE_Kernel)kernel))
+            continue;
+
+        char name[32];
+        snprintf(name, sizeof(name), "q15 lanes %s", ape_kernel_name((APE_Kernel)kernel));
+        success = check_hash(name, run_q15_lanes(spectrums, input_q15), EXPECTED_Q15_HASH) && success;
+    }
+
+    return success ? 0 : 1;
+}